@@ -0,0 +1,550 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+/**
+ * Asynchronous file I/O for the parent side of marker (exam reader, rubric
+ * saves, results writer), so none of them sits in a system call while it
+ * has other work to do.
+ *
+ * A caller fills in IoOps, one system call each, and submits them alone or
+ * as a chain that runs in order and stops at the first failure (a short
+ * read or write counts as one). It reaps them later as they complete, each
+ * with its result in res. Three backends run the same ops:
+ *
+ *   IO_URING    io_uring through the raw system calls (no liburing): one
+ *               io_uring_enter per submission, completions read straight
+ *               off the mapped completion queue
+ *   IO_THREADS  worker threads making the blocking calls, for kernels
+ *               without io_uring or with it disabled
+ *   IO_SYNC     the calls are made at submission; for --simulate, where
+ *               the parent must not depend on real time
+ *
+ * An AsyncIo belongs to one thread: only that thread submits and reaps, and
+ * it reaps everything before closing. notify, if set, is called from
+ * another thread whenever ops complete so the owner can be woken.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define ASYNC_IO_ENTRIES 64     // io_uring submission queue size, and the most ops
+                                // a caller may have in flight
+
+enum IoBackend { IO_SYNC, IO_THREADS, IO_URING };
+
+enum IoOpcode { IOP_OPEN, IOP_READ, IOP_WRITE, IOP_FSYNC, IOP_FDATASYNC, IOP_CLOSE,
+                IOP_RENAME };
+
+// One system call. Owned by the caller, who keeps it (and what it points
+// to) in place until it is reaped.
+struct IoOp {
+    int         opcode;     // IoOpcode
+    int         fd;         // READ, WRITE, FSYNC, FDATASYNC, CLOSE
+    const char *path;       // OPEN; RENAME: from
+    const char *path2;      // RENAME: to
+    int         flags;      // OPEN: open(2) flags; files are created 0644
+    void       *buf;        // READ, WRITE
+    uint32_t    len;
+    int64_t     off;        // READ, WRITE: file offset, -1 = current position
+    int         res;        // once reaped: what the call returned, or -errno
+                            // (-ECANCELED if an earlier op of its chain failed)
+    void       *user;       // the caller's
+};
+
+// io_uring instance: the three mappings and the ring pointers into them
+struct Uring {
+    int           fd;
+    unsigned     *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned     *cq_head, *cq_tail, *cq_mask;
+    io_uring_sqe *sqes;
+    io_uring_cqe *cqes;
+    void         *sq_map, *cq_map;
+    size_t        sq_map_len, cq_map_len, sqes_len;
+    unsigned      entries;
+};
+
+struct AsyncIo {
+    int   backend = IO_SYNC;            // IoBackend in use
+    int   in_flight = 0;                // ops submitted, not reaped yet
+    void (*notify)(void *) = nullptr;
+    void *notify_arg = nullptr;
+    std::atomic<bool> stop{false};
+
+    // IO_URING; with notify, completions also bump event_fd, which the
+    // waker thread turns into notify calls
+    Uring       ring = {};
+    int         event_fd = -1;
+    std::thread waker;
+
+    // IO_THREADS (done is also where IO_SYNC leaves its ops)
+    std::mutex                      mu;
+    std::condition_variable         work;       // queue is not empty
+    std::condition_variable         completed;  // done is not empty
+    std::deque<std::vector<IoOp *>> queue;      // chains waiting for a worker
+    std::vector<IoOp *>             done;       // completed, not reaped yet
+    std::vector<std::thread>        workers;
+};
+
+static inline const char *io_backend_name(int backend) {
+    switch (backend) {
+    case IO_URING:   return "io_uring";
+    case IO_THREADS: return "threads";
+    default:         return "sync";
+    }
+}
+
+/**
+ * A zeroed op of the given kind on fd, at the current file position.
+ */
+static inline IoOp io_op(int opcode, int fd, void *user) {
+    IoOp op;
+    std::memset(&op, 0, sizeof(op));
+    op.opcode = opcode;
+    op.fd     = fd;
+    op.off    = -1;
+    op.user   = user;
+    return op;
+}
+
+/**
+ * Make op's system call here and now. Returns its result, or -errno.
+ */
+static inline int io_run(const IoOp *op) {
+    long rc = -1;
+    switch (op->opcode) {
+    case IOP_OPEN:
+        rc = open(op->path, op->flags | O_CLOEXEC, 0644);
+        break;
+    case IOP_READ:
+        rc = op->off < 0 ? read(op->fd, op->buf, op->len)
+                         : pread(op->fd, op->buf, op->len, op->off);
+        break;
+    case IOP_WRITE:
+        rc = op->off < 0 ? write(op->fd, op->buf, op->len)
+                         : pwrite(op->fd, op->buf, op->len, op->off);
+        break;
+    case IOP_FSYNC:
+        rc = fsync(op->fd);
+        break;
+    case IOP_FDATASYNC:
+        rc = fdatasync(op->fd);
+        break;
+    case IOP_CLOSE:
+        rc = close(op->fd);
+        break;
+    case IOP_RENAME:
+        rc = rename(op->path, op->path2);
+        break;
+    default:
+        errno = EINVAL;
+        break;
+    }
+    return rc < 0 ? -errno : static_cast<int>(rc);
+}
+
+/**
+ * Run a chain in order, as io_uring would: after a failure or a short read
+ * or write, the rest of the chain is cancelled.
+ */
+static inline void io_run_chain(IoOp *const *ops, int n) {
+    bool failed = false;
+    for (int i = 0; i < n; i++) {
+        IoOp *op = ops[i];
+        if (failed) {
+            op->res = -ECANCELED;
+            continue;
+        }
+        op->res = io_run(op);
+        failed = op->res < 0 ||
+                 ((op->opcode == IOP_READ || op->opcode == IOP_WRITE) &&
+                  static_cast<uint32_t>(op->res) < op->len);
+    }
+}
+
+// --- IO_URING -----------------------------------------------------------------
+
+static inline int uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                              unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                                    flags, nullptr, 0));
+}
+
+static inline void uring_unmap(Uring *r) {
+    if (r->sqes && r->sqes != MAP_FAILED) {
+        munmap(r->sqes, r->sqes_len);
+    }
+    if (r->cq_map && r->cq_map != MAP_FAILED && r->cq_map != r->sq_map) {
+        munmap(r->cq_map, r->cq_map_len);
+    }
+    if (r->sq_map && r->sq_map != MAP_FAILED) {
+        munmap(r->sq_map, r->sq_map_len);
+    }
+    close(r->fd);
+}
+
+/**
+ * Set up an io_uring with entries submission slots and check that the
+ * kernel has every opcode IoOp needs. Returns 0, or -errno.
+ */
+static inline int uring_open(Uring *r, unsigned entries) {
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    std::memset(r, 0, sizeof(*r));
+    r->fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if (r->fd < 0) {
+        return -errno;
+    }
+
+    r->entries    = p.sq_entries;
+    r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    r->sqes_len   = p.sq_entries * sizeof(io_uring_sqe);
+    bool single   = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        r->sq_map_len = r->cq_map_len = std::max(r->sq_map_len, r->cq_map_len);
+    }
+    r->sq_map = mmap(nullptr, r->sq_map_len, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    r->cq_map = single ? r->sq_map
+                       : mmap(nullptr, r->cq_map_len, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+    r->sqes   = static_cast<io_uring_sqe *>(
+        mmap(nullptr, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+             r->fd, IORING_OFF_SQES));
+    if (r->sq_map == MAP_FAILED || r->cq_map == MAP_FAILED || r->sqes == MAP_FAILED) {
+        int err = errno;
+        uring_unmap(r);
+        return -err;
+    }
+
+    char *sq = static_cast<char *>(r->sq_map);
+    char *cq = static_cast<char *>(r->cq_map);
+    r->sq_head  = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+    r->sq_tail  = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+    r->sq_mask  = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+    r->sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+    r->cq_head  = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+    r->cq_tail  = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+    r->cq_mask  = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+    r->cqes     = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+
+    // RENAMEAT (5.11) is the newest opcode used
+    static const int needed[] = {IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_WRITE,
+                                 IORING_OP_FSYNC, IORING_OP_CLOSE, IORING_OP_RENAMEAT};
+    std::vector<char> buf(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+    io_uring_probe *probe = reinterpret_cast<io_uring_probe *>(buf.data());
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        int err = errno;
+        uring_unmap(r);
+        return -err;
+    }
+    for (int op : needed) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+            uring_unmap(r);
+            return -EOPNOTSUPP;
+        }
+    }
+    return 0;
+}
+
+static inline void uring_prep(io_uring_sqe *sqe, IoOp *op) {
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = reinterpret_cast<uintptr_t>(op);
+    sqe->fd        = op->fd;
+    switch (op->opcode) {
+    case IOP_OPEN:
+        sqe->opcode     = IORING_OP_OPENAT;
+        sqe->fd         = AT_FDCWD;
+        sqe->addr       = reinterpret_cast<uintptr_t>(op->path);
+        sqe->len        = 0644;
+        sqe->open_flags = static_cast<uint32_t>(op->flags | O_CLOEXEC);
+        break;
+    case IOP_READ:
+    case IOP_WRITE:
+        sqe->opcode = (op->opcode == IOP_READ) ? IORING_OP_READ : IORING_OP_WRITE;
+        sqe->addr   = reinterpret_cast<uintptr_t>(op->buf);
+        sqe->len    = op->len;
+        sqe->off    = static_cast<uint64_t>(op->off); // -1: current position
+        break;
+    case IOP_FSYNC:
+    case IOP_FDATASYNC:
+        sqe->opcode      = IORING_OP_FSYNC;
+        sqe->fsync_flags = (op->opcode == IOP_FDATASYNC) ? IORING_FSYNC_DATASYNC : 0;
+        break;
+    case IOP_CLOSE:
+        sqe->opcode = IORING_OP_CLOSE;
+        break;
+    case IOP_RENAME:
+        sqe->opcode = IORING_OP_RENAMEAT;
+        sqe->fd     = AT_FDCWD;
+        sqe->addr   = reinterpret_cast<uintptr_t>(op->path);
+        sqe->len    = static_cast<uint32_t>(AT_FDCWD);
+        sqe->addr2  = reinterpret_cast<uintptr_t>(op->path2);
+        break;
+    }
+}
+
+/**
+ * Queue a chain of n ops and hand it to the kernel. Returns 0, or -errno
+ * if the kernel refused it (nothing of it was submitted then).
+ */
+static inline int uring_submit(Uring *r, IoOp *const *ops, int n) {
+    unsigned tail = *r->sq_tail;
+    unsigned mask = *r->sq_mask;
+    for (int i = 0; i < n; i++) {
+        unsigned idx = (tail + i) & mask;
+        uring_prep(&r->sqes[idx], ops[i]);
+        if (i + 1 < n) {
+            r->sqes[idx].flags |= IOSQE_IO_LINK;
+        }
+        r->sq_array[idx] = idx;
+    }
+    __atomic_store_n(r->sq_tail, tail + n, __ATOMIC_RELEASE);
+
+    int rc;
+    while ((rc = uring_enter(r->fd, n, 0, 0)) < 0 && errno == EINTR) {
+    }
+    if (rc < 0) {
+        // not consumed (no SQ polling), so the entries can be taken back
+        int err = errno;
+        __atomic_store_n(r->sq_tail, tail, __ATOMIC_RELEASE);
+        return -err;
+    }
+    return 0;
+}
+
+/**
+ * Move completed ops to out, first waiting for one if wait is set.
+ * Returns how many.
+ */
+static inline int uring_reap(Uring *r, std::vector<IoOp *> *out, bool wait) {
+    unsigned head = *r->cq_head;
+    unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    while (wait && head == tail) {
+        if (uring_enter(r->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            return 0;
+        }
+        tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+    }
+    int n = 0;
+    for (; head != tail; head++, n++) {
+        io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        IoOp *op = reinterpret_cast<IoOp *>(static_cast<uintptr_t>(cqe->user_data));
+        op->res = cqe->res;
+        out->push_back(op);
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+/**
+ * Waker thread (IO_URING with notify): call notify whenever the kernel
+ * signals event_fd, until stop.
+ */
+static inline void uring_waker(AsyncIo *io) {
+    uint64_t count;
+    while (read(io->event_fd, &count, sizeof(count)) > 0 || errno == EINTR) {
+        if (io->stop.load(std::memory_order_acquire)) {
+            return;
+        }
+        io->notify(io->notify_arg);
+    }
+}
+
+// --- IO_THREADS ---------------------------------------------------------------
+
+static inline void io_worker(AsyncIo *io) {
+    std::unique_lock<std::mutex> lk(io->mu);
+    while (true) {
+        io->work.wait(lk, [io] { return io->stop.load() || !io->queue.empty(); });
+        if (io->queue.empty()) {
+            return; // stopping, and everything submitted has run
+        }
+        std::vector<IoOp *> chain = std::move(io->queue.front());
+        io->queue.pop_front();
+        lk.unlock();
+        io_run_chain(chain.data(), static_cast<int>(chain.size()));
+        lk.lock();
+        io->done.insert(io->done.end(), chain.begin(), chain.end());
+        io->completed.notify_one();
+        if (io->notify) {
+            lk.unlock();
+            io->notify(io->notify_arg);
+            lk.lock();
+        }
+    }
+}
+
+// --- interface ----------------------------------------------------------------
+
+/**
+ * Set io up with the backend wanted, falling back from IO_URING to
+ * IO_THREADS (with workers threads) if io_uring is unavailable, and to
+ * IO_SYNC if no thread can be started. notify(arg), if given, is called
+ * from another thread whenever ops complete. Returns the backend in use;
+ * *why, if given, says why io_uring was not used (0 if it was, or was not
+ * wanted).
+ */
+static inline int async_io_open(AsyncIo *io, int backend, int workers,
+                                void (*notify)(void *), void *arg, int *why) {
+    io->notify     = notify;
+    io->notify_arg = arg;
+    io->in_flight  = 0;
+    io->stop.store(false);
+    if (why) {
+        *why = 0;
+    }
+
+    if (backend == IO_URING) {
+        int rc = uring_open(&io->ring, ASYNC_IO_ENTRIES);
+        if (rc == 0 && notify) {
+            io->event_fd = eventfd(0, EFD_CLOEXEC);
+            if (io->event_fd < 0 ||
+                syscall(__NR_io_uring_register, io->ring.fd, IORING_REGISTER_EVENTFD,
+                        &io->event_fd, 1) < 0) {
+                rc = -errno;
+            } else {
+                try {
+                    io->waker = std::thread(uring_waker, io);
+                } catch (const std::system_error &e) {
+                    rc = -e.code().value();
+                }
+            }
+            if (rc != 0) {
+                if (io->event_fd >= 0) {
+                    close(io->event_fd);
+                    io->event_fd = -1;
+                }
+                uring_unmap(&io->ring);
+            }
+        }
+        if (rc == 0) {
+            io->backend = IO_URING;
+            return IO_URING;
+        }
+        if (why) {
+            *why = -rc;
+        }
+        backend = IO_THREADS;
+    }
+
+    if (backend == IO_THREADS) {
+        try {
+            for (int i = 0; i < workers; i++) {
+                io->workers.emplace_back(io_worker, io);
+            }
+            io->backend = IO_THREADS;
+            return IO_THREADS;
+        } catch (const std::system_error &) {
+            if (!io->workers.empty()) {
+                io->backend = IO_THREADS;   // run with the workers we got
+                return IO_THREADS;
+            }
+        }
+    }
+    io->backend = IO_SYNC;
+    return IO_SYNC;
+}
+
+/**
+ * Submit a chain of n ops (1 to ASYNC_IO_ENTRIES in flight in total). Each
+ * op is reaped on its own; an op the kernel refused is reaped with its
+ * error like any other.
+ */
+static inline void async_io_submit(AsyncIo *io, IoOp *const *ops, int n) {
+    io->in_flight += n;
+    if (io->backend == IO_URING) {
+        int rc = uring_submit(&io->ring, ops, n);
+        if (rc == 0) {
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            ops[i]->res = i == 0 ? rc : -ECANCELED;
+        }
+        io->done.insert(io->done.end(), ops, ops + n);
+        return;
+    }
+    if (io->backend == IO_THREADS) {
+        std::lock_guard<std::mutex> lk(io->mu);
+        io->queue.emplace_back(ops, ops + n);
+        io->work.notify_one();
+        return;
+    }
+    io_run_chain(ops, n);
+    io->done.insert(io->done.end(), ops, ops + n);
+}
+
+static inline void async_io_submit(AsyncIo *io, IoOp *op) {
+    async_io_submit(io, &op, 1);
+}
+
+/**
+ * Move the ops that have completed to out. With wait set and something in
+ * flight, first waits until at least one has. Returns how many.
+ */
+static inline int async_io_reap(AsyncIo *io, std::vector<IoOp *> *out, bool wait) {
+    wait = wait && io->in_flight > 0;
+    size_t before = out->size();
+    if (io->backend == IO_THREADS) {
+        std::unique_lock<std::mutex> lk(io->mu);
+        if (wait) {
+            io->completed.wait(lk, [io] { return !io->done.empty(); });
+        }
+        out->insert(out->end(), io->done.begin(), io->done.end());
+        io->done.clear();
+    } else {
+        // refused submissions (IO_URING) and IO_SYNC ops are already here
+        out->insert(out->end(), io->done.begin(), io->done.end());
+        io->done.clear();
+        if (io->backend == IO_URING) {
+            uring_reap(&io->ring, out, wait && out->size() == before);
+        }
+    }
+    int n = static_cast<int>(out->size() - before);
+    io->in_flight -= n;
+    return n;
+}
+
+/**
+ * Tear io down. Everything submitted must have been reaped.
+ */
+static inline void async_io_close(AsyncIo *io) {
+    io->stop.store(true, std::memory_order_release);
+    if (io->backend == IO_URING) {
+        if (io->waker.joinable()) {
+            uint64_t one = 1;
+            while (write(io->event_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+            }
+            io->waker.join();
+        }
+        if (io->event_fd >= 0) {
+            close(io->event_fd);
+        }
+        uring_unmap(&io->ring);
+    } else if (io->backend == IO_THREADS) {
+        {
+            std::lock_guard<std::mutex> lk(io->mu);
+            io->work.notify_all();
+        }
+        for (std::thread &t : io->workers) {
+            t.join();
+        }
+    }
+}
+
+#endif
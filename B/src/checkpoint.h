@@ -0,0 +1,104 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+/**
+ * Checkpoint file of a --persist run.
+ *
+ * marker maps it (MAP_SHARED) before starting any TA and updates it in
+ * place as work completes, so whenever marker stops, the file says how
+ * far the run got:
+ *
+ *   CheckpointHeader
+ *   rubric[num_questions]      letters as of the latest correction
+ *   CheckpointSlot[ring_slots] exams in flight, each followed by one done
+ *                              flag per question (slot_stride bytes apart)
+ *
+ * Progress is the number of exams retired, the input position up to which
+ * every exam is done, and which exams just after it are done too: with
+ * --schedule exams are loaded (and retired) out of input order, but never
+ * more than CHECKPOINT_WINDOW positions past the first one not done. A
+ * restart skips the input up to there, skips the exams flagged done after
+ * it and loads the rest again; the done flags of the exams that were in
+ * flight say which of their questions to skip. With --results a question
+ * only counts as marked once its row is committed, and a restart cuts the
+ * file back to the rows committed.
+ *
+ * The parent switches between two progress records (writing the spare one,
+ * then flipping current), so a crash mid-update leaves the previous one
+ * intact. Nothing is fsync'd: the file survives marker dying, and a machine
+ * crash loses at most what the kernel had not written back yet.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#define CHECKPOINT_MAGIC    "MRKCKPT1"
+#define CHECKPOINT_VERSION  3
+#define CHECKPOINT_NAME_MAX 256     // exam source path and exam names, with the '\0'
+#define CHECKPOINT_WINDOW   256     // positions past resume_pos an exam may be done
+
+struct CheckpointProgress {
+    int64_t  retired;                       // exams fully marked
+    uint64_t resume_pos;                    // every exam up to this input position is done
+    uint64_t check_pos;                     // the last of them retired (0 = none)
+    char     last_name[CHECKPOINT_NAME_MAX]; // its file name, to check the input
+    uint64_t done_after[CHECKPOINT_WINDOW / 64]; // bit i: exam at resume_pos + 1 + i is done
+};
+
+struct CheckpointHeader {
+    char     magic[8];                      // CHECKPOINT_MAGIC, not NUL-terminated
+    uint32_t version;                       // CHECKPOINT_VERSION
+    uint32_t num_questions;
+    uint32_t ring_slots;
+    int32_t  shmid;                         // segment of the run using it, removed
+                                            // by the next one if that run crashed
+    uint64_t size;                          // whole file, to catch truncation
+    char     exam_source[CHECKPOINT_NAME_MAX]; // exam_dir (real path) it belongs to
+
+    std::atomic<uint32_t> current;          // progress[current] is valid
+    uint32_t pad;
+    CheckpointProgress    progress[2];      // parent only
+    std::atomic<uint64_t> rubric_version;   // TAs, under mutex_rubric
+    std::atomic<uint64_t> results_size;     // bytes of the --results file committed
+                                            // (0 = none), by the results writer
+};
+
+// One exam in flight; pos 0 = free (positions start at 1)
+struct CheckpointSlot {
+    std::atomic<uint64_t> pos;              // input position after this exam
+    char student_id[8];
+    char name[CHECKPOINT_NAME_MAX];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+              std::atomic<uint8_t>::is_always_lock_free &&
+              sizeof(std::atomic<uint8_t>) == 1,
+              "the checkpoint is shared by processes through a file mapping");
+
+static inline size_t checkpoint_slot_stride(int num_questions) {
+    return (sizeof(CheckpointSlot) + num_questions + 7) & ~static_cast<size_t>(7);
+}
+
+static inline size_t checkpoint_size(int num_questions, int ring_slots) {
+    size_t rubric = (static_cast<size_t>(num_questions) + 7) & ~static_cast<size_t>(7);
+    return sizeof(CheckpointHeader) + rubric +
+           ring_slots * checkpoint_slot_stride(num_questions);
+}
+
+static inline std::atomic<char> *checkpoint_rubric(CheckpointHeader *ck) {
+    return reinterpret_cast<std::atomic<char> *>(ck + 1);
+}
+
+static inline CheckpointSlot *checkpoint_slot(CheckpointHeader *ck, int i) {
+    size_t rubric = (static_cast<size_t>(ck->num_questions) + 7) & ~static_cast<size_t>(7);
+    return reinterpret_cast<CheckpointSlot *>(
+        reinterpret_cast<char *>(ck + 1) + rubric +
+        i * checkpoint_slot_stride(ck->num_questions));
+}
+
+static inline std::atomic<uint8_t> *checkpoint_done(CheckpointSlot *slot) {
+    return reinterpret_cast<std::atomic<uint8_t> *>(slot + 1);
+}
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef EXAM_BATCH_H
+#define EXAM_BATCH_H
+
+/**
+ * Exam storage shared by marker and pack_exams.
+ *
+ * An exam directory holds one exam<anything>.txt per student, student
+ * number on the first line, loaded in natural order (exam2.txt before
+ * exam10.txt). A packed batch (.exb) holds the same exams in one file
+ * that marker maps instead of opening each file:
+ *
+ *   ExamBatchHeader
+ *   records, each 8-byte aligned: ExamRecord, name[name_len], text[text_len]
+ *   index: uint64_t offset of record i, for i < count
+ *
+ * text is the original file contents, so the student number is also the
+ * first 4 bytes of text; it is repeated in the record header so loading
+ * an exam does not need to look at the text at all.
+ *
+ * The student number may be followed by optional header lines, up to the
+ * first line that is not one of them (and within the first 255 bytes):
+ *
+ *   Priority: 2        priority class 0-999, higher goes first (default 0)
+ *   Deadline: 90.5     seconds after the run starts (default none)
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <dirent.h>
+
+#define EXAM_BATCH_MAGIC   "EXAMBAT1"
+#define EXAM_BATCH_VERSION 1
+
+struct ExamBatchHeader {
+    char     magic[8];      // EXAM_BATCH_MAGIC, not NUL-terminated
+    uint32_t version;       // EXAM_BATCH_VERSION
+    uint32_t count;         // exams in the batch
+    uint64_t index_off;     // uint64_t[count] record offsets
+    uint64_t size;          // whole file, to catch truncation
+};
+
+struct ExamRecord {
+    char     student_id[4]; // "0001", no '\0'
+    uint16_t name_len;      // original file name, for the log
+    uint16_t pad;
+    uint32_t text_len;
+    uint32_t pad2;
+};
+
+static_assert(sizeof(ExamBatchHeader) == 32 && sizeof(ExamRecord) == 16,
+              "batch layout is part of the file format");
+
+#define EXAM_HEADER_MAX 255     // bytes of an exam looked at for its header
+
+// Scheduling metadata of one exam (header lines, or marker --manifest)
+struct ExamMeta {
+    int     priority;       // class, higher goes first
+    int64_t deadline_us;    // after the run starts, or -1 for none
+};
+
+/**
+ * Read the optional header lines of an exam (its first len bytes of text,
+ * student number line included) into meta. Unknown lines end the header;
+ * so does a bad value, which leaves that field at its default.
+ */
+static inline void parse_exam_header(const char *text, size_t len, ExamMeta *meta) {
+    meta->priority    = 0;
+    meta->deadline_us = -1;
+    std::string head(text, std::min(len, static_cast<size_t>(EXAM_HEADER_MAX)));
+    size_t at = head.find('\n');
+    while (at != std::string::npos) {
+        const char *line = head.c_str() + at + 1;
+        char *end;
+        if (std::strncmp(line, "Priority:", 9) == 0) {
+            long p = std::strtol(line + 9, &end, 10);
+            if (end == line + 9 || p < 0 || p > 999) {
+                return;
+            }
+            meta->priority = static_cast<int>(p);
+        } else if (std::strncmp(line, "Deadline:", 9) == 0) {
+            double d = std::strtod(line + 9, &end);
+            if (end == line + 9 || !(d >= 0 && d < 1e9)) {
+                return;
+            }
+            meta->deadline_us = static_cast<int64_t>(d * 1e6);
+        } else {
+            return;
+        }
+        at = head.find('\n', at + 1);
+    }
+}
+
+/**
+ * Exam files are exam<anything>.txt; everything else in the directory
+ * (stray files, editor backups, the rubric if it lives there) is ignored.
+ */
+static inline bool is_exam_name(const char *name) {
+    size_t len = std::strlen(name);
+    return len > 8 && std::strncmp(name, "exam", 4) == 0 &&
+           std::strcmp(name + len - 4, ".txt") == 0;
+}
+
+static inline void sort_exam_names(std::vector<std::string>::iterator first,
+                                   std::vector<std::string>::iterator last) {
+    std::sort(first, last, [](const std::string &a, const std::string &b) {
+        return strverscmp(a.c_str(), b.c_str()) < 0;
+    });
+}
+
+/**
+ * Append the exam file names in dir to names, in natural order.
+ * Returns 0 on success, -1 if dir cannot be opened (errno is set).
+ */
+static inline int list_exam_dir(const char *dir, std::vector<std::string> *names) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        return -1;
+    }
+    size_t before = names->size();
+    struct dirent *e;
+    while ((e = readdir(d)) != nullptr) {
+        if (is_exam_name(e->d_name)) {
+            names->push_back(e->d_name);
+        }
+    }
+    closedir(d);
+    sort_exam_names(names->begin() + before, names->end());
+    return 0;
+}
+
+/**
+ * Check the header of a mapped batch of size bytes.
+ * Returns nullptr if it is valid, otherwise what is wrong with it.
+ */
+static inline const char *exam_batch_check(const char *base, size_t size) {
+    if (size < sizeof(ExamBatchHeader) ||
+        std::memcmp(base, EXAM_BATCH_MAGIC, 8) != 0) {
+        return "not an exam batch";
+    }
+    const ExamBatchHeader *h = reinterpret_cast<const ExamBatchHeader *>(base);
+    if (h->version != EXAM_BATCH_VERSION) {
+        return "unsupported batch version";
+    }
+    if (h->size != size || h->index_off % 8 != 0 ||
+        h->index_off > size || (size - h->index_off) / 8 < h->count) {
+        return "batch is truncated or corrupt";
+    }
+    return nullptr;
+}
+
+/**
+ * Record i of a batch already accepted by exam_batch_check(), or nullptr
+ * if its offset or lengths run past the end of the file.
+ */
+static inline const ExamRecord *exam_batch_record(const char *base, size_t size,
+                                                  uint32_t i) {
+    const ExamBatchHeader *h = reinterpret_cast<const ExamBatchHeader *>(base);
+    uint64_t off;
+    std::memcpy(&off, base + h->index_off + 8 * static_cast<uint64_t>(i), sizeof(off));
+    if (off % 8 != 0 || off > size || size - off < sizeof(ExamRecord)) {
+        return nullptr;
+    }
+    const ExamRecord *r = reinterpret_cast<const ExamRecord *>(base + off);
+    if (size - off - sizeof(ExamRecord) <
+        static_cast<uint64_t>(r->name_len) + r->text_len) {
+        return nullptr;
+    }
+    return r;
+}
+
+static inline const char *exam_record_name(const ExamRecord *r) {
+    return reinterpret_cast<const char *>(r + 1);
+}
+
+static inline const char *exam_record_text(const ExamRecord *r) {
+    return exam_record_name(r) + r->name_len;
+}
+
+#endif // EXAM_BATCH_H
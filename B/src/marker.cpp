@@ -3,54 +3,561 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cstdarg>
 #include <ctime>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <errno.h>
 #include <semaphore.h>
-#include <cstdarg> 
-
-#define NUM_QUESTIONS 5
-
-// Shared memory structure
-struct SharedArea {
-    char rubric[NUM_QUESTIONS];         // Rubric letters stored in shared memory
-    int  question_state[NUM_QUESTIONS]; // 0 = not started, 1 = marking, 2 = done
-    char student_id[5];                 // "0001" - 4 digits + '\0'
-    int  exam_done;                     // 1 = current exam appears fully marked
-    int  terminate;                     // 1 = stop signal (student 9999 or no more exams)
-    int  rubric_dirty;                  // 1 = rubric changed in SHM, parent must write to file
-
-    int  log_counter;                   // Shared global action counter (to observe interleaving)
-
-    // --- NEW: semaphores for Part B (process-shared) ---
-    sem_t mutex_rubric;     // protects rubric[] and rubric_dirty
-    sem_t mutex_questions;  // protects question_state[] and exam_done
-    sem_t mutex_log;        // protects log_counter and G-printing
-    sem_t exam_ready;       // used to wake TAs when a new exam is loaded
-};
+#include <sched.h>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <string>
+#include <deque>
+#include <memory>
+#include <unordered_set>
+#include <unordered_map>
+#include <set>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <system_error>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/prctl.h>
+#include <signal.h>
+
+#include "async_io.h"
+#include "checkpoint.h"
+#include "exam_batch.h"
+#include "shared_area.h"
+
+#define MAX_QUESTIONS 4096      // sanity cap on the rubric size
+#define DEFAULT_RING_SLOTS 4    // exams the parent keeps loaded ahead of the TAs
+#define DEFAULT_PREFETCH 8      // exams the reader keeps read ahead of the ring
+#define HEARTBEAT_MS 100        // idle TAs check in (and the supervisor runs) this often
+#define TA_HANG_MS 3000         // a TA this late checking in is killed and replaced
+#define SHRINK_IDLE_MS 1000     // a TA idle this long may be retired from the pool
+
 /**
  * Seydi Cheikh Wade (101323727)
  * Sean Baldaia (101315064)
  */
 /**
- * Sleep for a random number of milliseconds in [min_ms, max_ms].
+ * Time as seen by the marking logic, in microseconds: the virtual clock
+ * with --simulate, the monotonic clock otherwise.
+ */
+static int64_t clock_us(SharedArea *sh) {
+    return sh->simulate ? sh->sim_now_us : now_us();
+}
+
+/**
+ * Simulation: hand the CPU from actor me to the runnable actor with the
+ * earliest wake time (lowest id on ties) and advance the virtual clock to
+ * it. Returns once me is picked again; returns at once if me is SIM_DONE.
+ * Only the running actor touches scheduler state, so no lock is needed.
+ */
+static void sim_switch(SharedArea *sh, int me) {
+    int next = -1;
+    int64_t best = INT64_MAX;
+    for (int i = 0; i <= sh->num_TAs; i++) {
+        SimActor *a = sim_actor(sh, i);
+        bool ready = a->state == SIM_RUNNABLE ||
+                     (a->state == SIM_BLOCKED && a->wake_at != INT64_MAX);
+        if (ready && a->wake_at < best) {
+            best = a->wake_at;
+            next = i;
+        }
+    }
+
+    SimActor *self = sim_actor(sh, me);
+    if (next == -1) {
+        if (self->state != SIM_DONE) {
+            std::fprintf(stderr, "simulate: every actor is blocked (deadlock)\n");
+            std::exit(EXIT_FAILURE);
+        }
+        return; // last actor leaving
+    }
+
+    SimActor *n = sim_actor(sh, next);
+    if (n->state == SIM_BLOCKED) {
+        n->state = SIM_RUNNABLE; // its timeout expired first
+        n->timed_out = 1;
+    }
+    if (best > sh->sim_now_us) {
+        sh->sim_now_us = best;
+    }
+    if (next == me) {
+        return;
+    }
+
+    sem_post(&n->turn);
+    if (self->state != SIM_DONE) {
+        while (sem_wait(&self->turn) != 0 && errno == EINTR) {
+            // retry
+        }
+    }
+}
+
+/**
+ * Simulation: a freshly started actor waits until the scheduler picks it.
+ */
+static void sim_begin(SharedArea *sh, int me) {
+    if (!sh->simulate) {
+        return;
+    }
+    while (sem_wait(&sim_actor(sh, me)->turn) != 0 && errno == EINTR) {
+        // retry
+    }
+}
+
+/**
+ * Simulation: actor me is finished and leaves the schedule.
+ */
+static void sim_leave(SharedArea *sh, int me) {
+    if (!sh->simulate) {
+        return;
+    }
+    sim_actor(sh, me)->state = SIM_DONE;
+    sim_switch(sh, me);
+}
+
+/**
+ * TA: promise the supervisor to check in again within busy_us plus
+ * HEARTBEAT_MS. A TA that misses its deadline by TA_HANG_MS is hung.
+ */
+static void ta_checkin(SharedArea *sh, int ta_id, int64_t busy_us) {
+    ta_slot(sh, ta_id)->deadline_us.store(clock_us(sh) + busy_us + HEARTBEAT_MS * 1000LL,
+                                          std::memory_order_relaxed);
+}
+
+/**
+ * Spend delay_us reviewing or marking: a real sleep, or in simulation an
+ * advance of this actor's virtual time.
+ */
+static void work_for_us(SharedArea *sh, int actor, int64_t delay_us) {
+    bool ta = actor < sh->num_TAs;
+    if (ta) {
+        ta_checkin(sh, actor, delay_us);
+    }
+    if (!sh->simulate) {
+        // Busy time is credited once spent; marker-stat adds the time since
+        // busy_since_us, so a sampled busy% never runs ahead of the clock
+        TaStats *stats = ta ? ta_stats(sh, actor) : nullptr;
+        int64_t t0 = now_us();
+        if (stats) {
+            stats->busy_since_us.store(t0, std::memory_order_release);
+        }
+        usleep(delay_us);
+        if (stats) {
+            stats->busy_since_us.store(-1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            metric_add(stats->busy_us, now_us() - t0);
+            stats->busy_since_us.store(0, std::memory_order_release);
+        }
+        return;
+    }
+    SimActor *a = sim_actor(sh, actor);
+    a->wake_at = sh->sim_now_us + delay_us;
+    a->state = SIM_RUNNABLE;
+    sim_switch(sh, actor);
+    if (ta) {
+        metric_add(ta_stats(sh, actor)->busy_us, delay_us);
+    }
+}
+
+// Per-TA xoshiro256** generator: fast, and fully determined by the seed
+struct Rng {
+    uint64_t s[4];
+};
+
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Derive stream `stream` (the TA id) from the run seed, so the same
+ * --seed always gives every TA the same sequence of draws.
+ */
+static void rng_seed(Rng *rng, uint64_t seed, int stream) {
+    uint64_t x = seed ^ (0xd1b54a32d192ed03ULL * (static_cast<uint64_t>(stream) + 1));
+    for (int i = 0; i < 4; i++) {
+        rng->s[i] = splitmix64(&x);
+    }
+}
+
+static uint64_t rng_next(Rng *rng) {
+    uint64_t *s = rng->s;
+    uint64_t r = s[1] * 5;
+    r = ((r << 7) | (r >> 57)) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = (s[3] << 45) | (s[3] >> 19);
+    return r;
+}
+
+// Uniform in [0, 1)
+static double rng_unit(Rng *rng) {
+    return (rng_next(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * Sleep for a random number of milliseconds drawn from spec using the
+ * configured distribution, scaled by --delay-scale:
+ * uniform in [min, max], min + exponential with mean (max - min) / 2
+ * (capped at 10 * max), or fixed at the midpoint.
+ */
+static void sleep_random_ms(SharedArea *sh, int actor, Rng *rng, const DelaySpec &spec) {
+    double delay;
+    switch (sh->delay_dist) {
+    case DIST_EXPONENTIAL: {
+        double mean = (spec.max_ms - spec.min_ms) / 2.0;
+        delay = spec.min_ms - mean * std::log(1.0 - rng_unit(rng));
+        delay = std::min(delay, 10.0 * spec.max_ms);
+        break;
+    }
+    case DIST_FIXED:
+        delay = (spec.min_ms + spec.max_ms) / 2.0;
+        break;
+    default: {
+        int range = spec.max_ms - spec.min_ms + 1;
+        delay = spec.min_ms + static_cast<double>(rng_next(rng) % range);
+        break;
+    }
+    }
+    // convert ms to microseconds
+    work_for_us(sh, actor, static_cast<int64_t>(delay * 1000.0 * sh->delay_scale));
+}
+
+/**
+ * --trace: Chrome trace-event JSON of what every TA and the parent is doing
+ * (rubric reviews, each question marked, waits for work, contended lock
+ * acquisitions, and each exam from load to done), for viewing as timelines
+ * in Perfetto or chrome://tracing.
+ *
+ * Every actor formats its events into a private buffer and appends whole
+ * buffers to the file with one O_APPEND write, so actors never coordinate
+ * and batches never interleave mid-event. The parent writes the opening
+ * '[' and the track names first, each event starts with ",\n", and the
+ * parent closes the array once every TA is gone. With tracing off t_trace
+ * is nullptr and each hook is one test of a thread-local; trace_clock()
+ * does not even read the clock.
+ */
+#define TRACE_BUF_BYTES (64 * 1024)
+#define TRACE_EVENT_MAX 512     // longest formatted event
+
+struct TraceBuf {
+    int    tid;                 // TA id, or num_TAs for the parent
+    size_t used;
+    char   buf[TRACE_BUF_BYTES];
+};
+
+static int   g_trace_fd = -1;   // the --trace file, shared by every actor
+static pid_t g_trace_pid;       // "pid" of every event: one process in the viewer
+static thread_local TraceBuf *t_trace = nullptr; // this actor's buffer, if tracing
+
+/**
+ * Trace timestamp in nanoseconds: CLOCK_MONOTONIC, or the virtual clock
+ * with --simulate. 0 when this actor is not tracing.
+ */
+static int64_t trace_clock(SharedArea *sh) {
+    if (!t_trace) {
+        return 0;
+    }
+    if (sh->simulate) {
+        return sh->sim_now_us * 1000;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static void trace_flush(TraceBuf *tb) {
+    const char *p = tb->buf;
+    size_t len = tb->used;
+    while (len > 0) {
+        ssize_t w = write(g_trace_fd, p, len);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::perror("write trace");
+            break;
+        }
+        p += w;
+        len -= w;
+    }
+    tb->used = 0;
+}
+
+static void trace_event(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/**
+ * Append one formatted event to this actor's buffer, flushing it first if
+ * the event might not fit.
+ */
+static void trace_event(const char *fmt, ...) {
+    TraceBuf *tb = t_trace;
+    if (tb->used + TRACE_EVENT_MAX > sizeof(tb->buf)) {
+        trace_flush(tb);
+    }
+    va_list ap;
+    va_start(ap, fmt);
+    int n = std::vsnprintf(tb->buf + tb->used, TRACE_EVENT_MAX, fmt, ap);
+    va_end(ap);
+    tb->used += std::min(n, TRACE_EVENT_MAX - 1);
+}
+
+/**
+ * Complete event: name (with " Q<q>" if q > 0) ran on this actor's track
+ * from t0_ns, taken with trace_clock(), until now.
+ */
+static void trace_span(SharedArea *sh, const char *cat, const char *name, int q,
+                       int64_t t0_ns, const char *sid = nullptr) {
+    if (!t_trace) {
+        return;
+    }
+    int64_t t1_ns = trace_clock(sh);
+    char qs[16] = "";
+    if (q > 0) {
+        std::snprintf(qs, sizeof(qs), " Q%d", q);
+    }
+    trace_event(",\n{\"name\":\"%s%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                "\"ts\":%lld.%03d,\"dur\":%lld.%03d%s%s%s}",
+                name, qs, cat, static_cast<int>(g_trace_pid), t_trace->tid,
+                static_cast<long long>(t0_ns / 1000), static_cast<int>(t0_ns % 1000),
+                static_cast<long long>((t1_ns - t0_ns) / 1000),
+                static_cast<int>((t1_ns - t0_ns) % 1000),
+                sid ? ",\"args\":{\"student\":\"" : "", sid ? sid : "", sid ? "\"}" : "");
+}
+
+/**
+ * Instant event on this actor's track, e.g. a rubric correction.
+ */
+static void trace_instant(SharedArea *sh, const char *cat, const char *name, int q) {
+    if (!t_trace) {
+        return;
+    }
+    int64_t t_ns = trace_clock(sh);
+    trace_event(",\n{\"name\":\"%s Q%d\",\"cat\":\"%s\",\"ph\":\"i\",\"s\":\"t\","
+                "\"pid\":%d,\"tid\":%d,\"ts\":%lld.%03d}",
+                name, q, cat, static_cast<int>(g_trace_pid), t_trace->tid,
+                static_cast<long long>(t_ns / 1000), static_cast<int>(t_ns % 1000));
+}
+
+/**
+ * Begin ('b', parent on load) or end ('e', the TA that marks the last
+ * question) the async span of exam seq, so the viewer shows how long each
+ * exam waited before and between TAs.
+ */
+static void trace_exam(SharedArea *sh, char ph, int seq, const char *sid) {
+    if (!t_trace) {
+        return;
+    }
+    int64_t t_ns = trace_clock(sh);
+    trace_event(",\n{\"name\":\"exam %s\",\"cat\":\"exam\",\"ph\":\"%c\",\"id\":%d,"
+                "\"pid\":%d,\"tid\":%d,\"ts\":%lld.%03d}",
+                sid, ph, seq, static_cast<int>(g_trace_pid), t_trace->tid,
+                static_cast<long long>(t_ns / 1000), static_cast<int>(t_ns % 1000));
+}
+
+/**
+ * Start tracing on the calling TA (or parent) thread, if --trace is on.
+ */
+static void trace_begin(int tid) {
+    if (g_trace_fd < 0) {
+        return;
+    }
+    // A forked TA inherits the parent's pointer; it gets its own buffer
+    t_trace = new TraceBuf;
+    t_trace->tid  = tid;
+    t_trace->used = 0;
+}
+
+/**
+ * Flush and stop tracing on the calling thread.
+ */
+static void trace_end() {
+    if (!t_trace) {
+        return;
+    }
+    trace_flush(t_trace);
+    delete t_trace;
+    t_trace = nullptr;
+}
+
+/**
+ * Parent: create the trace file, write the opening '[' and a named track
+ * per TA and for the parent, and start tracing the parent.
+ * Returns 0 on success, -1 otherwise.
+ */
+static int trace_open(const char *path, int num_TAs) {
+    g_trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (g_trace_fd < 0) {
+        std::perror(path);
+        return -1;
+    }
+    g_trace_pid = getpid();
+    int pid = static_cast<int>(g_trace_pid);
+    dprintf(g_trace_fd, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+                        "\"args\":{\"name\":\"marker\"}}", pid);
+    for (int i = 0; i <= num_TAs; i++) {
+        char name[16];
+        std::snprintf(name, sizeof(name), i < num_TAs ? "TA %d" : "parent", i);
+        dprintf(g_trace_fd, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                            "\"args\":{\"name\":\"%s\"}}"
+                            ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%d,"
+                            "\"tid\":%d,\"args\":{\"sort_index\":%d}}",
+                pid, i, name, pid, i, i);
+    }
+    trace_begin(num_TAs);
+    return 0;
+}
+
+/**
+ * Parent, once every TA has flushed: close the array and the file.
+ */
+static void trace_close() {
+    if (g_trace_fd < 0) {
+        return;
+    }
+    trace_end();
+    dprintf(g_trace_fd, "\n]\n");
+    close(g_trace_fd);
+    g_trace_fd = -1;
+}
+
+/**
+ * Take a mutex semaphore on behalf of TA ta_id (-1 for the parent),
+ * timing the wait into its stats when it blocks. The uncontended path is a
+ * single sem_trywait. A blocked TA does not count as hung: if the holder
+ * died, the supervisor releases the lock.
+ */
+static void lock_sem(SharedArea *sh, sem_t *sem, int ta_id) {
+    if (sem_trywait(sem) == 0) {
+        return;
+    }
+    int64_t t0 = clock_us(sh);
+    int64_t trace_t0 = trace_clock(sh);
+    TaStats *stats = ta_id >= 0 ? ta_stats(sh, ta_id) : nullptr;
+    int32_t was = 0;
+    if (stats) {
+        was = stats->state.load(std::memory_order_relaxed);
+        metric_set(stats->state, TA_BLOCKED);
+        ta_slot(sh, ta_id)->deadline_us.store(INT64_MAX, std::memory_order_relaxed);
+    }
+    while (sem_wait(sem) != 0 && errno == EINTR) {
+        // retry
+    }
+    if (stats) {
+        metric_add(stats->lock_wait_us, clock_us(sh) - t0);
+        metric_add(stats->lock_waits, 1);
+        metric_set(stats->state, was);
+        ta_checkin(sh, ta_id, 0);
+    }
+    trace_span(sh, "lock", sem == &sh->mutex_rubric ? "lock mutex_rubric"
+                                                    : "lock work deque", 0, trace_t0);
+}
+
+static sem_t *wait_sem(SharedArea *sh, WaitOn which) {
+    return which == WAIT_WORK ? &sh->work_items : &sh->parent_wake;
+}
+
+/**
+ * Block actor on work_items or parent_wake, for at most timeout_ms if it
+ * is >= 0. Returns 0 when a token was taken, -1 on timeout.
+ */
+static int wait_event(SharedArea *sh, int actor, WaitOn which, int timeout_ms) {
+    sem_t *sem = wait_sem(sh, which);
+
+    if (sh->simulate) {
+        SimActor *a = sim_actor(sh, actor);
+        int64_t deadline = timeout_ms < 0 ? INT64_MAX
+                                          : sh->sim_now_us + timeout_ms * 1000LL;
+        while (sem_trywait(sem) != 0) {
+            a->state     = SIM_BLOCKED;
+            a->wait_on   = which;
+            a->wake_at   = deadline;
+            a->timed_out = 0;
+            sim_switch(sh, actor);
+            if (a->timed_out) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    if (timeout_ms < 0) {
+        while (sem_wait(sem) != 0) {
+            if (errno != EINTR) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec  += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    while (sem_timedwait(sem, &deadline) != 0) {
+        if (errno != EINTR) {
+            return -1; // ETIMEDOUT
+        }
+    }
+    return 0;
+}
+
+/**
+ * Post work_items or parent_wake. In simulation every actor blocked on it
+ * becomes runnable now; the ones that lose the race block again.
  */
-static void sleep_random_ms(int min_ms, int max_ms) {
-    int range = max_ms - min_ms + 1;
-    int delay = min_ms + (std::rand() % range);
-    usleep(delay * 1000); // convert ms to microseconds
+static void post_event(SharedArea *sh, WaitOn which) {
+    sem_post(wait_sem(sh, which));
+    if (!sh->simulate) {
+        return;
+    }
+    for (int i = 0; i <= sh->num_TAs; i++) {
+        SimActor *a = sim_actor(sh, i);
+        if (a->state == SIM_BLOCKED && a->wait_on == which) {
+            a->state   = SIM_RUNNABLE;
+            a->wake_at = sh->sim_now_us;
+        }
+    }
 }
 
 /**
- * Load rubric from file into shared memory.
- * Format: "1, A", "2, B", etc. (5 lines).
+ * Read the rubric file into letters, one entry per line.
+ * Format: "1, A", "2, B", etc. The number of lines sets the question count,
+ * and every question 1..N must appear exactly once.
  * Only the question number and first character after the comma are used.
  */
-static int load_rubric(const char *rubric_path, SharedArea *sh) {
+static int read_rubric(const char *rubric_path, std::vector<char> *letters) {
     FILE *f = std::fopen(rubric_path, "r");
     if (!f) {
         std::perror("fopen rubric");
@@ -60,12 +567,11 @@ static int load_rubric(const char *rubric_path, SharedArea *sh) {
     char line[256];
     int qnum;
     char letter;
+    std::vector<std::pair<int, char>> entries;
 
-    for (int i = 0; i < NUM_QUESTIONS; i++) {
-        if (!std::fgets(line, sizeof(line), f)) {
-            std::fprintf(stderr, "Rubric file has fewer than %d lines\n", NUM_QUESTIONS);
-            std::fclose(f);
-            return -1;
+    while (std::fgets(line, sizeof(line), f)) {
+        if (line[0] == '\n' || line[0] == '\0') {
+            continue; // tolerate blank lines
         }
         if (std::sscanf(line, "%d , %c", &qnum, &letter) != 2 &&
             std::sscanf(line, "%d,%c", &qnum, &letter) != 2) {
@@ -73,428 +579,3804 @@ static int load_rubric(const char *rubric_path, SharedArea *sh) {
             std::fclose(f);
             return -1;
         }
-        if (qnum < 1 || qnum > NUM_QUESTIONS) {
-            std::fprintf(stderr, "Invalid question number in rubric: %d\n", qnum);
+        entries.emplace_back(qnum, letter);
+    }
+    std::fclose(f);
+
+    int n = static_cast<int>(entries.size());
+    if (n == 0 || n > MAX_QUESTIONS) {
+        std::fprintf(stderr, "Rubric must have 1..%d lines, found %d\n",
+                     MAX_QUESTIONS, n);
+        return -1;
+    }
+
+    letters->assign(n, '\0');
+    for (const auto &e : entries) {
+        if (e.first < 1 || e.first > n || (*letters)[e.first - 1] != '\0') {
+            std::fprintf(stderr, "Invalid question number in rubric: %d\n", e.first);
+            return -1;
+        }
+        (*letters)[e.first - 1] = e.second;
+    }
+    return 0;
+}
+
+/**
+ * Read the --manifest file into manifest: one line per exam, "student,
+ * priority[, deadline]" such as "0042, 2, 90.5", which overrides the
+ * exam's own header lines (see exam_batch.h). Blank lines and lines
+ * starting with '#' are skipped.
+ */
+static int read_manifest(const char *path, std::unordered_map<std::string, ExamMeta> *manifest) {
+    FILE *f = std::fopen(path, "r");
+    if (!f) {
+        std::perror(path);
+        return -1;
+    }
+
+    char line[256];
+    while (std::fgets(line, sizeof(line), f)) {
+        if (line[0] == '\n' || line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+        char sid[5];
+        int priority;
+        double deadline;
+        int n = std::sscanf(line, " %4[0-9] , %d , %lf", sid, &priority, &deadline);
+        if (n < 2 || std::strlen(sid) != 4 || priority < 0 || priority > 999 ||
+            (n == 3 && !(deadline >= 0 && deadline < 1e9))) {
+            std::fprintf(stderr, "Bad manifest line: %s\n", line);
             std::fclose(f);
             return -1;
         }
-        sh->rubric[qnum - 1] = letter;
+        (*manifest)[sid] = {priority, n == 3 ? static_cast<int64_t>(deadline * 1e6) : -1};
+    }
+    std::fclose(f);
+    return 0;
+}
+
+// Parent only: pids of the forked helpers, by HelperBit index (-1 if not
+// forked, or already reaped)
+static pid_t g_helper_pid[2] = {-1, -1};
+
+static const char *const g_helper_name[2] = {"log drainer", "results writer"};
+
+/**
+ * Parent: report how helper i (a HelperBit index) ended, from its wait
+ * status. Returns true if it exited normally.
+ */
+static bool helper_exited(int i, int status) {
+    if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS) {
+        return true;
+    }
+    if (WIFSIGNALED(status)) {
+        std::fprintf(stderr, "%s died (signal %d)\n", g_helper_name[i], WTERMSIG(status));
+    } else {
+        std::fprintf(stderr, "%s died (exit status %d)\n", g_helper_name[i],
+                     WEXITSTATUS(status));
+    }
+    return false;
+}
+
+/**
+ * Parent: reap a forked helper (log drainer, results writer) that died
+ * before the end of the run. From then on its records are dropped, so no
+ * producer waits on its ring forever. Returns the HelperBits lost so far.
+ */
+static int check_helpers(SharedArea *sh) {
+    for (int i = 0; i < 2; i++) {
+        int status;
+        if (g_helper_pid[i] <= 0 || waitpid(g_helper_pid[i], &status, WNOHANG) != g_helper_pid[i]) {
+            continue;
+        }
+        g_helper_pid[i] = -1;
+        helper_exited(i, status);
+        sh->helper_lost.fetch_or(1 << i, std::memory_order_release);
+    }
+    return sh->helper_lost.load(std::memory_order_acquire);
+}
+
+/**
+ * Helper: producer source (a TA, or -1 for the parent) found its ring
+ * full; wait while full() holds for the consumer (helper, a HelperBit) to
+ * catch up. Returns false if the helper died: the record is then dropped.
+ * As in lock_sem(), a TA waiting here is blocked, not hung.
+ */
+template <typename Full>
+static bool wait_ring_space(SharedArea *sh, int source, int helper, Full full) {
+    TaStats *stats = source >= 0 ? ta_stats(sh, source) : nullptr;
+    int32_t was = 0;
+    if (stats) {
+        was = stats->state.load(std::memory_order_relaxed);
+        metric_set(stats->state, TA_BLOCKED);
+        ta_slot(sh, source)->deadline_us.store(INT64_MAX, std::memory_order_relaxed);
+    }
+    bool room = true;
+    while (full()) {
+        int lost = source < 0 ? check_helpers(sh)
+                              : sh->helper_lost.load(std::memory_order_acquire);
+        if (lost & helper) {
+            room = false;
+            break;
+        }
+        usleep(100);
+    }
+    if (stats) {
+        metric_set(stats->state, was);
+        ta_checkin(sh, source, 0);
+    }
+    return room;
+}
+
+/**
+ * Helper: append one record to a producer's log ring (with the slots a
+ * long text continues into). Never blocks on other producers: the G-number
+ * comes from an atomic fetch-add and the record is published with a
+ * release store of head. Only waits if the drainer has fallen a full ring
+ * behind (and drops the record if the drainer died).
+ */
+static void log_event(SharedArea *sh, int source, LogEvent event,
+                      const char *sid = nullptr, int a0 = 0, int a1 = 0,
+                      int a2 = 0, const char *text = nullptr) {
+    LogRing *r = log_ring(sh, source < 0 ? sh->num_TAs : source);
+    size_t len = text ? strnlen(text, LOG_TEXT_MAX - 1) : 0;
+    size_t rest = len < sizeof(LogRecord::text) ? 0 : len + 1 - sizeof(LogRecord::text);
+    uint64_t slots = 1 + (rest + sizeof(LogRecord) - 1) / sizeof(LogRecord);
+    uint64_t h = r->head.load(std::memory_order_relaxed);
+    if (h + slots - r->tail.load(std::memory_order_acquire) > LOG_RING_SIZE &&
+        !wait_ring_space(sh, source, HELPER_LOG, [r, h, slots] {
+            return h + slots - r->tail.load(std::memory_order_acquire) > LOG_RING_SIZE;
+        })) {
+        return;
+    }
+
+    LogRecord *rec = &r->rec[h & (LOG_RING_SIZE - 1)];
+    rec->g      = sh->log_counter.fetch_add(1, std::memory_order_relaxed);
+    rec->source = source;
+    rec->event  = event;
+    rec->more   = static_cast<uint16_t>(slots - 1);
+    rec->arg[0] = a0;
+    rec->arg[1] = a1;
+    rec->arg[2] = a2;
+    std::snprintf(rec->sid, sizeof(rec->sid), "%s", sid ? sid : "");
+    if (rest == 0) {
+        std::snprintf(rec->text, sizeof(rec->text), "%s", text ? text : "");
+    } else {
+        char whole[LOG_TEXT_MAX];
+        std::snprintf(whole, sizeof(whole), "%s", text);
+        std::memcpy(rec->text, whole, sizeof(rec->text));
+        const char *from = whole + sizeof(rec->text);
+        for (uint64_t i = 1; i < slots; i++, from += sizeof(LogRecord)) {
+            size_t n = std::min(rest, sizeof(LogRecord));
+            std::memcpy(&r->rec[(h + i) & (LOG_RING_SIZE - 1)], from, n);
+            rest -= n;
+        }
+    }
+
+    r->head.store(h + slots, std::memory_order_release);
+}
+
+/**
+ * Helper: log for the parent.
+ */
+static void log_parent(SharedArea *sh, LogEvent event,
+                       const char *sid = nullptr, int a0 = 0,
+                       const char *text = nullptr) {
+    log_event(sh, -1, event, sid, a0, 0, 0, text);
+}
+
+/**
+ * Helper: log for a TA.
+ */
+static void log_ta(SharedArea *sh, int ta_id, LogEvent event,
+                   const char *sid = nullptr, int a0 = 0, int a1 = 0,
+                   int a2 = 0) {
+    log_event(sh, ta_id, event, sid, a0, a1, a2);
+}
+
+/**
+ * Helper: record for the results writer (--results) that TA ta_id marked
+ * question q of exam seq (student sid) with letter. Reserves a position with one
+ * fetch-add and publishes the record with a release store: no lock and no
+ * I/O. Only waits if the writer has fallen a full ring behind (and drops
+ * the record if the writer died).
+ */
+static void record_result(SharedArea *sh, int ta_id, int seq, const char *sid, int q,
+                          char letter) {
+    ResultRing *r = result_ring(sh);
+    uint64_t pos = r->head.fetch_add(1, std::memory_order_relaxed);
+    if (pos - r->tail.load(std::memory_order_acquire) >= RESULT_RING_SIZE &&
+        !wait_ring_space(sh, ta_id, HELPER_RESULTS, [r, pos] {
+            return pos - r->tail.load(std::memory_order_acquire) >= RESULT_RING_SIZE;
+        })) {
+        return;
+    }
+
+    ResultRecord *rec = &r->rec[pos & (RESULT_RING_SIZE - 1)];
+    rec->t_us   = clock_us(sh);
+    rec->ta     = ta_id;
+    rec->slot   = static_cast<uint32_t>(seq % sh->ring_slots);
+    rec->q      = static_cast<uint16_t>(q + 1);
+    rec->letter = letter;
+    std::snprintf(rec->sid, sizeof(rec->sid), "%s", sid);
+
+    rec->seq.store(pos + 1, std::memory_order_release);
+}
+
+/**
+ * Drainer: the string argument of the record at position t of ring r,
+ * joined back together in buf if it continues into the next slots.
+ */
+static const char *record_text(const LogRing *r, uint64_t t, char (&buf)[LOG_TEXT_MAX]) {
+    const LogRecord *rec = &r->rec[t & (LOG_RING_SIZE - 1)];
+    if (rec->more == 0) {
+        return rec->text;
+    }
+    std::memcpy(buf, rec->text, sizeof(rec->text));
+    size_t used = sizeof(rec->text);
+    for (uint64_t i = 1; i <= rec->more && used < sizeof(buf); i++) {
+        size_t n = std::min(sizeof(LogRecord), sizeof(buf) - used);
+        std::memcpy(buf + used, &r->rec[(t + i) & (LOG_RING_SIZE - 1)], n);
+        used += n;
+    }
+    buf[sizeof(buf) - 1] = '\0';
+    return buf;
+}
+
+/**
+ * Drainer: format one record (with its string argument text) as the
+ * familiar "[G%05d][who] ..." line into out (cap >= LOG_LINE_MIN). Returns
+ * the length of the whole line; if that is more than cap, out holds only a
+ * truncated copy without the newline.
+ */
+#define LOG_LINE_MIN 64
+
+static size_t format_record(const LogRecord *rec, const char *text, const char *exam_dir,
+                            char *out, size_t cap) {
+    int n;
+    if (rec->source < 0) {
+        n = std::snprintf(out, cap, "[G%05llu][PARENT] ",
+                          static_cast<unsigned long long>(rec->g));
+    } else {
+        n = std::snprintf(out, cap, "[G%05llu][TA %d] ",
+                          static_cast<unsigned long long>(rec->g), rec->source);
+    }
+    out += n;
+    cap -= n;
+
+    const int *a = rec->arg;
+    int m = 0;
+    switch (rec->event) {
+    case EV_EXAM_LOADED:
+        m = std::snprintf(out, cap, "Loaded exam %02d from %s/%s, student %s",
+                          a[0], exam_dir, text, rec->sid);
+        break;
+    case EV_SENTINEL:
+        m = std::snprintf(out, cap, "Student 9999 reached. Setting terminate flag.");
+        break;
+    case EV_RUBRIC_SAVING:
+        m = std::snprintf(out, cap, "Detected rubric change. Saving rubric to file...");
+        break;
+    case EV_RUBRIC_SAVE_FAILED:
+        m = std::snprintf(out, cap, "Failed to save rubric file");
+        break;
+    case EV_TERMINATING:
+        m = std::snprintf(out, cap, "Termination condition reached. Waiting for TAs...");
+        break;
+    case EV_ALL_DONE:
+        m = std::snprintf(out, cap, "All done.");
+        break;
+    case EV_START_STUDENT:
+        m = std::snprintf(out, cap, "Starting work on student %s", rec->sid);
+        break;
+    case EV_RUBRIC_CHECK:
+        m = std::snprintf(out, cap, "Checking rubric for Q%d (current '%c')", a[0], a[1]);
+        break;
+    case EV_RUBRIC_CORRECT:
+        m = std::snprintf(out, cap, "Correcting rubric Q%d: %c -> %c (in shared memory)",
+                          a[0], a[1], a[2]);
+        break;
+    case EV_RUBRIC_SAME:
+        m = std::snprintf(out, cap, "Rubric for Q%d unchanged (still '%c')", a[0], a[1]);
+        break;
+    case EV_MARKING:
+        m = std::snprintf(out, cap, "Marking Q%d for student %s (rubric '%c')",
+                          a[0], rec->sid, a[1]);
+        break;
+    case EV_FINISHED:
+        m = std::snprintf(out, cap, "Finished Q%d for student %s", a[0], rec->sid);
+        break;
+    case EV_EXAM_DONE:
+        m = std::snprintf(out, cap, "All questions for student %s appear done.", rec->sid);
+        break;
+    case EV_WAITING:
+        m = std::snprintf(out, cap, "Waiting for next exam...");
+        break;
+    case EV_TA_EXIT:
+        m = std::snprintf(out, cap, "No more exams to mark, exiting.");
+        break;
+    case EV_TA_STARTED:
+        m = std::snprintf(out, cap, "Started TA %d (%d questions queued, %d TAs running)",
+                          a[0], a[1], a[2]);
+        break;
+    case EV_TA_DIED:
+        m = std::snprintf(out, cap, "TA %d died (%s)", a[0], text);
+        break;
+    case EV_TA_HUNG:
+        m = std::snprintf(out, cap, "TA %d has not checked in for %d ms%s", a[0], a[1],
+                          a[2] ? ", killing it" : "");
+        break;
+    case EV_REQUEUED:
+        m = std::snprintf(out, cap, "Requeued %sQ%d for student %s from TA %d",
+                          a[2] == WORK_REVIEW ? "review of " : "", a[0], rec->sid, a[1]);
+        break;
+    case EV_REVIEW_DONE:
+        m = std::snprintf(out, cap, "Rubric reviewed for student %s, releasing its questions",
+                          rec->sid);
+        break;
+    case EV_TA_RETIRED:
+        m = std::snprintf(out, cap, "Backlog is low, leaving the pool.");
+        break;
+    case EV_RESUMED:
+        m = std::snprintf(out, cap, "Resuming from checkpoint: %d exams already marked,"
+                          " rubric version %d", a[0], a[1]);
+        break;
+    case EV_ALREADY_MARKED:
+        m = std::snprintf(out, cap, "Q%d for student %s was marked before the restart",
+                          a[0], rec->sid);
+        break;
+    case EV_COUNTED_FOR:
+        m = std::snprintf(out, cap, "Q%d for student %s was marked by TA %d before it died",
+                          a[0], rec->sid, a[1]);
+        break;
+    case EV_REVIEW_SKIPPED:
+        m = std::snprintf(out, cap, "Skipping rubric review (rubric version %d)", a[0]);
+        break;
+    default:
+        m = std::snprintf(out, cap, "unknown event %u", rec->event);
+        break;
+    }
+    size_t len = static_cast<size_t>(n) + m + 1;
+    if (len <= cap + n) {
+        out[m] = '\n';
+    }
+    return len;
+}
+
+/**
+ * Write a whole buffer to fd, retrying short writes. Returns 0, or -1
+ * (after printing what failed) on error.
+ */
+static int write_all(int fd, const char *buf, size_t len, const char *what) {
+    while (len > 0) {
+        ssize_t w = write(fd, buf, len);
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::perror(what);
+            return -1;
+        }
+        buf += w;
+        len -= w;
+    }
+    return 0;
+}
+
+/**
+ * Code executed by the log drainer process.
+ * Merges all producer rings back into G order, formats the records and
+ * writes them to stdout in batches. A G-number that stays missing for
+ * LOG_GAP_TIMEOUT_MS (its producer died between fetch-add and publish) is
+ * skipped so one lost record cannot stall the log. Exits once log_closed
+ * is set and every ring is empty.
+ */
+#define LOG_BATCH_BYTES    (64 * 1024)
+#define LOG_GAP_TIMEOUT_MS 200
+
+static void drain_logs(SharedArea *sh, const char *exam_dir) {
+    static char batch[LOG_BATCH_BYTES];
+    char text_buf[LOG_TEXT_MAX];
+    size_t used = 0;
+    int num_rings = sh->num_TAs + 1;
+    uint64_t next_g = 0;
+    int gap_ms = 0;     // how long the lowest record has waited for next_g
+    int idle_us = 100;  // back-off while every ring is empty
+
+    while (true) {
+        // log_closed is only set once every producer has finished, so if it
+        // is set before the scan, an empty scan means the rings are drained
+        bool closed = sh->log_closed.load(std::memory_order_acquire);
+
+        // Find the lowest published record across all rings
+        int best = -1;
+        uint64_t best_g = 0;
+        for (int i = 0; i < num_rings; i++) {
+            LogRing *r = log_ring(sh, i);
+            uint64_t t = r->tail.load(std::memory_order_relaxed);
+            if (t == r->head.load(std::memory_order_acquire)) {
+                continue;
+            }
+            uint64_t g = r->rec[t & (LOG_RING_SIZE - 1)].g;
+            if (best == -1 || g < best_g) {
+                best = i;
+                best_g = g;
+            }
+        }
+
+        if (best != -1 && (best_g <= next_g || gap_ms >= LOG_GAP_TIMEOUT_MS)) {
+            LogRing *r = log_ring(sh, best);
+            uint64_t t = r->tail.load(std::memory_order_relaxed);
+            const LogRecord *rec = &r->rec[t & (LOG_RING_SIZE - 1)];
+            if (used + LOG_LINE_MIN > sizeof(batch)) {
+                write_all(STDOUT_FILENO, batch, used, "write log");
+                used = 0;
+            }
+            const char *text = record_text(r, t, text_buf);
+            size_t len = format_record(rec, text, exam_dir, batch + used, sizeof(batch) - used);
+            if (len > sizeof(batch) - used) {
+                // Did not fit: flush, then format it again at the start
+                write_all(STDOUT_FILENO, batch, used, "write log");
+                used = 0;
+                len = format_record(rec, text, exam_dir, batch, sizeof(batch));
+                if (len > sizeof(batch)) {
+                    len = sizeof(batch); // longer than a whole batch: cut it short
+                    batch[len - 1] = '\n';
+                }
+            }
+            used += len;
+            r->tail.store(t + 1 + rec->more, std::memory_order_release);
+            next_g = best_g + 1;
+            gap_ms = 0;
+            idle_us = 100;
+            continue;
+        }
+
+        // Nothing ready in G order: flush what we have and back off
+        if (used > 0) {
+            write_all(STDOUT_FILENO, batch, used, "write log");
+            used = 0;
+        }
+        if (best == -1) {
+            if (closed) {
+                break;
+            }
+            gap_ms = 0;
+            usleep(idle_us);
+            if (idle_us < 10000) {
+                idle_us *= 2;
+            }
+        } else {
+            gap_ms++;
+            usleep(1000);
+        }
+    }
+}
+
+// --persist: the checkpoint file, mapped before any TA starts so every TA
+// process sees it at the same address. nullptr without --persist.
+static CheckpointHeader *g_ckpt = nullptr;
+
+/**
+ * TA: record a rubric correction in the checkpoint (under mutex_rubric).
+ */
+static void checkpoint_correction(SharedArea *sh, int q, char letter) {
+    if (g_ckpt) {
+        checkpoint_rubric(g_ckpt)[q].store(letter, std::memory_order_relaxed);
+        g_ckpt->rubric_version.store(sh->rubric_version.load(std::memory_order_relaxed),
+                                     std::memory_order_release);
+    }
+}
+
+/**
+ * TA (the results writer with --results, once the row is on disk): record
+ * question q of exam seq as marked.
+ */
+static void checkpoint_marked(SharedArea *sh, int seq, int q) {
+    if (g_ckpt) {
+        CheckpointSlot *cs = checkpoint_slot(g_ckpt, seq % sh->ring_slots);
+        checkpoint_done(cs)[q].store(1, std::memory_order_release);
+    }
+}
+
+// The results file of a --results run, as handed to the writer
+struct ResultsWriter {
+    int     fd;                 // -1 once a write failed
+    int     commit_ms;          // --results-commit-ms
+    int64_t epoch_us;           // add to a record's clock_us() for Unix time
+    int     io_backend;         // how commits are issued (IoBackend)
+    int64_t size;               // bytes of the file committed
+};
+
+#define RESULTS_HEADER        "student,question,letter,ta,time\n"
+#define RESULTS_BATCH_BYTES   (64 * 1024)
+#define RESULT_ROW_MAX        64
+#define RESULT_GAP_TIMEOUT_MS 1000
+
+/**
+ * Results writer: format one record as a CSV row. Returns its length.
+ */
+static int format_result(const ResultRecord *rec, int64_t epoch_us, char *out, size_t cap) {
+    long long t = rec->t_us + epoch_us;
+    return std::snprintf(out, cap, "%s,%d,%c,%d,%lld.%06lld\n", rec->sid, rec->q,
+                         rec->letter, rec->ta, t / 1000000, t % 1000000);
+}
+
+// A group commit in flight: one write and an fdatasync linked behind it
+struct ResultsCommit {
+    IoOp   op[2];
+    size_t len;
+    int    pending;     // ops not reaped yet
+    uint64_t upto;      // ring position after its last row
+    std::vector<std::pair<uint32_t, uint16_t>> marked; // its (slot, question)s, --persist
+};
+
+/**
+ * Results writer: commit c is on disk (or the results file failed, and
+ * nothing more will be). Record the committed size and the done flags of
+ * its questions in the checkpoint, then publish how far the file is
+ * committed, waking the parent if it is waiting for that to retire an exam.
+ */
+static void commit_done(SharedArea *sh, ResultsWriter *rw, ResultsCommit *c) {
+    if (g_ckpt && rw->fd >= 0) {
+        g_ckpt->results_size.store(rw->size, std::memory_order_release);
+    }
+    for (const auto &m : c->marked) {
+        checkpoint_marked(sh, static_cast<int>(m.first), m.second);
+    }
+    c->marked.clear();
+    ResultRing *r = result_ring(sh);
+    // seq_cst, against the parent's store of commit_want then load of
+    // committed: one of the two sides sees the other
+    uint64_t was = r->committed.exchange(c->upto);
+    uint64_t want = r->commit_want.load();
+    if (!sh->simulate && was < want && c->upto >= want) {
+        sem_post(&sh->parent_wake);
+    }
+}
+
+/**
+ * Results writer: start one group commit, a single write and fdatasync of
+ * every row gathered since the last one, without waiting for it.
+ */
+static void start_commit(SharedArea *sh, AsyncIo *io, ResultsWriter *rw, ResultsCommit *c,
+                         char *buf, size_t len) {
+    if (rw->fd < 0) {
+        commit_done(sh, rw, c);
+        return;
+    }
+    c->op[0]     = io_op(IOP_WRITE, rw->fd, nullptr);
+    c->op[0].buf = buf;
+    c->op[0].len = static_cast<uint32_t>(len);
+    c->op[1]     = io_op(IOP_FDATASYNC, rw->fd, nullptr);
+    c->len       = len;
+    c->pending   = 2;
+    IoOp *chain[2] = {&c->op[0], &c->op[1]};
+    async_io_submit(io, chain, 2);
+}
+
+/**
+ * Results writer: collect the commit in flight (waiting for it if wait is
+ * set). A short write is finished synchronously; a failed one stops the
+ * results file (the rows keep being drained so no TA waits on a full ring).
+ */
+static void finish_commit(SharedArea *sh, AsyncIo *io, ResultsWriter *rw, ResultsCommit *c,
+                          bool wait) {
+    std::vector<IoOp *> done;
+    int n;
+    while (c->pending > 0 && (n = async_io_reap(io, &done, wait)) > 0) {
+        c->pending -= n;
+        if (c->pending > 0) {
+            continue;
+        }
+        int wrote = c->op[0].res;
+        int rc = 0;
+        if (wrote < 0) {
+            errno = -wrote;
+            std::perror("write results");
+            rc = -1;
+        } else if (static_cast<size_t>(wrote) < c->len) {
+            rc = write_all(rw->fd, static_cast<char *>(c->op[0].buf) + wrote,
+                           c->len - wrote, "write results");
+            if (rc == 0 && fdatasync(rw->fd) != 0) {
+                std::perror("fdatasync results");
+                rc = -1;
+            }
+        } else if (c->op[1].res < 0) {
+            errno = -c->op[1].res;
+            std::perror("fdatasync results");
+            rc = -1;
+        }
+        if (rc != 0) {
+            close(rw->fd);
+            rw->fd = -1;
+        } else {
+            rw->size += c->len;
+        }
+        commit_done(sh, rw, c);
+    }
+}
+
+/**
+ * Code executed by the results writer (--results), the one consumer of the
+ * results ring. Rows are gathered in a batch and committed once the oldest
+ * of them is commit_ms old (or the batch fills), so a crash loses at most
+ * one commit window and the TAs never wait on the disk. The writer does
+ * not wait for a commit either: it gathers the next batch in the other
+ * buffer meanwhile, and only waits when that one is due too. A position
+ * that stays reserved but unpublished for RESULT_GAP_TIMEOUT_MS (its TA
+ * died in between) is skipped. With --persist a question only counts as
+ * marked in the checkpoint once its row is committed. Exits once
+ * log_closed is set and the ring is empty.
+ */
+static void write_results(SharedArea *sh, ResultsWriter rw) {
+    static char batch[2][RESULTS_BATCH_BYTES];
+    int cur = 0;
+    size_t used = 0;
+    ResultRing *r = result_ring(sh);
+    int64_t oldest_us = 0;  // now_us() when the first uncommitted row came in
+    int64_t gap_us = 0;     // since when the next position has been reserved
+
+    std::vector<std::pair<uint32_t, uint16_t>> marked; // questions of the gathered rows
+
+    AsyncIo io;
+    ResultsCommit commit;
+    commit.pending = 0;
+    async_io_open(&io, rw.io_backend, 1, nullptr, nullptr, nullptr);
+
+    // Hand the gathered rows to a commit and switch to the other buffer
+    auto flush = [&] {
+        finish_commit(sh, &io, &rw, &commit, true);
+        commit.upto = r->tail.load(std::memory_order_relaxed);
+        commit.marked.swap(marked);
+        start_commit(sh, &io, &rw, &commit, batch[cur], used);
+        cur ^= 1;
+        used = 0;
+        oldest_us = 0;
+    };
+
+    while (true) {
+        finish_commit(sh, &io, &rw, &commit, false);
+        // log_closed is only set once every TA has finished; read before the
+        // ring, so a row published just before it is not missed
+        bool closed = sh->log_closed.load(std::memory_order_acquire);
+        uint64_t t = r->tail.load(std::memory_order_relaxed);
+        ResultRecord *rec = &r->rec[t & (RESULT_RING_SIZE - 1)];
+        int64_t now = now_us();
+
+        if (rec->seq.load(std::memory_order_acquire) == t + 1) {
+            if (used + RESULT_ROW_MAX > sizeof(batch[cur])) {
+                flush();
+            }
+            used += format_result(rec, rw.epoch_us, batch[cur] + used,
+                                  sizeof(batch[cur]) - used);
+            if (g_ckpt) {
+                marked.emplace_back(rec->slot, static_cast<uint16_t>(rec->q - 1));
+            }
+            if (oldest_us == 0) {
+                oldest_us = now;
+            }
+            r->tail.store(t + 1, std::memory_order_release);
+            gap_us = 0;
+            continue;
+        }
+
+        // Nothing published at tail: a TA may be mid-append, or dead
+        bool reserved = r->head.load(std::memory_order_acquire) != t;
+        if (reserved) {
+            if (gap_us == 0) {
+                gap_us = now;
+            } else if (now - gap_us >= RESULT_GAP_TIMEOUT_MS * 1000LL) {
+                r->tail.store(t + 1, std::memory_order_release);
+                gap_us = 0;
+                continue;
+            }
+        }
+        // A parent waiting on a commit to retire an exam gets one without
+        // waiting out the window
+        closed = closed && !reserved;
+        bool wanted = r->commit_want.load(std::memory_order_acquire) >
+                      r->committed.load(std::memory_order_relaxed);
+        if (used > 0 && (closed || wanted || now - oldest_us >= rw.commit_ms * 1000LL)) {
+            flush();
+        } else if (used == 0 && commit.pending == 0) {
+            r->committed.store(t, std::memory_order_release); // skipped positions only
+        }
+        if (closed) {
+            break;
+        }
+        usleep(1000);
+    }
+    finish_commit(sh, &io, &rw, &commit, true);
+    async_io_close(&io);
+    if (rw.fd >= 0) {
+        close(rw.fd);
+    }
+}
+
+/**
+ * Parent: open the --results file, appending to what a previous run wrote
+ * when resuming (resume), else starting it over with a header row. A
+ * resumed file is first cut back to the committed bytes (if > 0) the
+ * checkpoint has: rows past them are of questions it does not count as
+ * marked, which are marked again. Sets *size to the file's size.
+ * Returns the descriptor, or -1 (after printing why) on failure.
+ */
+static int open_results(const char *path, bool resume, uint64_t committed, int64_t *size) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | (resume ? 0 : O_TRUNC), 0644);
+    if (fd < 0) {
+        std::perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        std::perror(path);
+        close(fd);
+        return -1;
+    }
+    if (resume && committed > 0 && static_cast<uint64_t>(st.st_size) > committed) {
+        if (ftruncate(fd, static_cast<off_t>(committed)) != 0) {
+            std::perror(path);
+            close(fd);
+            return -1;
+        }
+        st.st_size = static_cast<off_t>(committed);
+    }
+    if (st.st_size == 0) {
+        if (write_all(fd, RESULTS_HEADER, sizeof(RESULTS_HEADER) - 1, path) != 0) {
+            close(fd);
+            return -1;
+        }
+        st.st_size = sizeof(RESULTS_HEADER) - 1;
+    }
+    *size = st.st_size;
+    return fd;
+}
+
+/**
+ * Read a consistent copy of the whole rubric without taking mutex_rubric:
+ * retry while a writer is mid-update or the sequence moved underneath us.
+ * A writer caught mid-update may be preempted, so yield to it rather than
+ * spin out the time slice.
+ */
+static void read_rubric_snapshot(SharedArea *sh, char *out) {
+    while (true) {
+        uint32_t before = sh->rubric_seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            sched_yield();
+            continue;
+        }
+        for (int i = 0; i < sh->num_questions; i++) {
+            out[i] = rubric_at(sh, i).load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sh->rubric_seq.load(std::memory_order_relaxed) == before) {
+            return;
+        }
+    }
+}
+
+/**
+ * TA: change rubric entry q to the next letter.
+ * Writers serialize on mutex_rubric and run inside a seqlock write section;
+ * the parent is woken only on the clean -> dirty transition.
+ * Returns the old letter and stores the new one in *newc and the version
+ * stamped on the entry in *stamp.
+ */
+static char correct_rubric(SharedArea *sh, int ta_id, int q, char *newc, uint64_t *stamp) {
+    TaSlot *me = ta_slot(sh, ta_id);
+    lock_sem(sh, &sh->mutex_rubric, ta_id);
+    me->held_lock.store(HELD_RUBRIC, std::memory_order_relaxed);
+    sh->rubric_seq.fetch_add(1, std::memory_order_acq_rel); // now odd
+
+    char old = rubric_at(sh, q).load(std::memory_order_relaxed);
+    char next = old + 1;
+    if (next > 'Z') {
+        next = 'A';  // wrap around to keep it printable
+    }
+    rubric_at(sh, q).store(next, std::memory_order_release);
+    uint64_t version = sh->rubric_version.fetch_add(1, std::memory_order_relaxed) + 1;
+    rubric_stamp(sh, q).store(version, std::memory_order_release);
+    checkpoint_correction(sh, q, next);
+
+    sh->rubric_seq.fetch_add(1, std::memory_order_release); // even again
+    me->held_lock.store(HELD_NONE, std::memory_order_relaxed);
+    sem_post(&sh->mutex_rubric);
+
+    if (sh->rubric_dirty.exchange(1) == 0) {
+        post_event(sh, WAIT_PARENT); // one wakeup per dirty period
+    }
+    *newc = next;
+    *stamp = version;
+    return old;
+}
+
+/**
+ * Parent's AsyncIo: ops completed, wake the parent loop to handle them.
+ */
+static void wake_parent(void *arg) {
+    post_event(static_cast<SharedArea *>(arg), WAIT_PARENT);
+}
+
+// Steps of a rubric save, each one AsyncIo op (two for SAVE_WRITE)
+enum SaveStep { SAVE_IDLE, SAVE_OPEN, SAVE_WRITE, SAVE_CLOSE, SAVE_RENAME, SAVE_OPEN_DIR,
+                SAVE_SYNC_DIR, SAVE_CLOSE_DIR };
+
+// Parent-side state of the write-behind rubric persister
+struct RubricWriter {
+    const char *path;
+    int         interval_ms;    // at most one save per interval of wall time
+    int64_t     last_save_ms;   // when the last save started (now_us, also with --simulate)
+    bool        durable;        // fsync the file and the rename (not with --simulate)
+    AsyncIo    *io;             // the parent's; completions wake it
+    int         step;           // SaveStep of the save in flight
+    int         pending;        // its ops not reaped yet
+    bool        failed;
+    int         fd;
+    std::string text;           // the snapshot being written
+    std::string tmp_path;
+    std::string dir;
+    IoOp        op[2];
+    int64_t     trace_t0;
+};
+
+/**
+ * Parent: start saving letters without ever leaving a truncated file:
+ * write "<path>.tmp", fsync it, rename it over the rubric and fsync the
+ * directory so the rename itself is durable. Each step is submitted when
+ * the previous one completes (rubric_save_step()). A simulated run saves
+ * as often in virtual time, i.e. thousands of times per real second, so it
+ * leaves out the fsyncs.
+ */
+static void start_rubric_save(RubricWriter *rw, const char *letters, int n) {
+    rw->text.clear();
+    char line[16];
+    for (int i = 0; i < n; i++) {
+        std::snprintf(line, sizeof(line), "%d, %c\n", i + 1, letters[i]);
+        rw->text += line;
+    }
+    rw->tmp_path = std::string(rw->path) + ".tmp";
+    const char *slash = std::strrchr(rw->path, '/');
+    rw->dir = !slash ? "." : slash == rw->path ? "/" : std::string(rw->path, slash);
+
+    rw->failed      = false;
+    rw->op[0]       = io_op(IOP_OPEN, -1, nullptr);
+    rw->op[0].path  = rw->tmp_path.c_str();
+    rw->op[0].flags = O_WRONLY | O_CREAT | O_TRUNC;
+    rw->step        = SAVE_OPEN;
+    rw->pending     = 1;
+    async_io_submit(rw->io, &rw->op[0]);
+}
+
+/**
+ * Parent: report what a failed save step returned (-errno in res).
+ */
+static void rubric_save_error(const char *what, int res) {
+    errno = -res;
+    std::perror(what);
+}
+
+/**
+ * Parent: the ops of the current save step have completed; check them and
+ * submit the next step. Returns false once the save is over.
+ */
+static bool rubric_save_step(RubricWriter *rw) {
+    IoOp *op = &rw->op[0];
+    switch (rw->step) {
+    case SAVE_OPEN:
+        if (op->res < 0) {
+            rubric_save_error("open rubric for write", op->res);
+            rw->failed = true;
+            return false;
+        }
+        rw->fd        = op->res;
+        rw->op[0]     = io_op(IOP_WRITE, rw->fd, nullptr);
+        rw->op[0].buf = &rw->text[0];
+        rw->op[0].len = static_cast<uint32_t>(rw->text.size());
+        rw->op[0].off = 0;
+        rw->op[1]     = io_op(IOP_FSYNC, rw->fd, nullptr);
+        {
+            IoOp *chain[2] = {&rw->op[0], &rw->op[1]};
+            rw->step    = SAVE_WRITE;
+            rw->pending = rw->durable ? 2 : 1;
+            async_io_submit(rw->io, chain, rw->pending);
+        }
+        return true;
+    case SAVE_WRITE:
+        if (op->res != static_cast<int>(rw->text.size()) ||
+            (rw->durable && rw->op[1].res != 0)) {
+            rubric_save_error("write rubric", op->res < 0 ? op->res
+                              : rw->op[1].res < 0 && rw->op[1].res != -ECANCELED
+                              ? rw->op[1].res : -EIO);
+            rw->failed = true;
+        }
+        rw->op[0] = io_op(IOP_CLOSE, rw->fd, nullptr);
+        rw->step  = SAVE_CLOSE;
+        break;
+    case SAVE_CLOSE:
+        if (rw->failed) {
+            unlink(rw->tmp_path.c_str());
+            return false;
+        }
+        rw->op[0]       = io_op(IOP_RENAME, -1, nullptr);
+        rw->op[0].path  = rw->tmp_path.c_str();
+        rw->op[0].path2 = rw->path;
+        rw->step        = SAVE_RENAME;
+        break;
+    case SAVE_RENAME:
+        if (op->res < 0) {
+            rubric_save_error("rename rubric", op->res);
+            unlink(rw->tmp_path.c_str());
+            rw->failed = true;
+            return false;
+        }
+        if (!rw->durable) {
+            return false;
+        }
+        // fsync the containing directory so the new name survives a crash
+        rw->op[0]       = io_op(IOP_OPEN, -1, nullptr);
+        rw->op[0].path  = rw->dir.c_str();
+        rw->op[0].flags = O_RDONLY | O_DIRECTORY;
+        rw->step        = SAVE_OPEN_DIR;
+        break;
+    case SAVE_OPEN_DIR:
+        if (op->res < 0) {
+            return false; // the rubric is saved, only the rename may not be durable
+        }
+        rw->fd    = op->res;
+        rw->op[0] = io_op(IOP_FSYNC, rw->fd, nullptr);
+        rw->step  = SAVE_SYNC_DIR;
+        break;
+    case SAVE_SYNC_DIR:
+        rw->op[0] = io_op(IOP_CLOSE, rw->fd, nullptr);
+        rw->step  = SAVE_CLOSE_DIR;
+        break;
+    default:
+        return false;
+    }
+    rw->pending = 1;
+    async_io_submit(rw->io, &rw->op[0]);
+    return true;
+}
+
+/**
+ * Parent: move the save in flight along as its ops complete; with wait
+ * set, until it is over. A failed save is logged and leaves the rubric
+ * dirty, so it is retried after the next interval.
+ */
+static void pump_rubric_save(RubricWriter *rw, SharedArea *sh, bool wait) {
+    std::vector<IoOp *> done;
+    while (rw->step != SAVE_IDLE) {
+        done.clear();
+        int n = async_io_reap(rw->io, &done, wait);
+        if (n == 0) {
+            return;
+        }
+        rw->pending -= n;
+        if (rw->pending > 0 || rubric_save_step(rw)) {
+            continue;
+        }
+        rw->step = SAVE_IDLE;
+        trace_span(sh, "io", "save rubric", 0, rw->trace_t0);
+        if (rw->failed) {
+            log_parent(sh, EV_RUBRIC_SAVE_FAILED);
+            sh->rubric_dirty.store(1); // retry after the next interval
+        }
+    }
+}
+
+/**
+ * Parent: if any TA changed the rubric in shared memory, write it to file.
+ * Bursts of corrections are coalesced: a save only happens once
+ * interval_ms of wall time has passed since the previous one (or when force
+ * is set). The interval is wall time in both modes: on the virtual clock it
+ * would pass on nearly every correction and the saves would dominate a
+ * simulated run.
+ * The rubric is copied with a seqlock read and written with no lock held,
+ * so TAs never wait on file I/O or on the parent; the parent does not wait
+ * either, the save runs through AsyncIo (force waits for it to finish).
+ *
+ * Returns how many ms until a pending save is due, or -1 if none is pending
+ * (or a save is still in flight: its completion wakes the parent). With
+ * --simulate a pending save is never waited for; the parent's next wakeup or
+ * the final forced flush writes it.
+ */
+static int flush_rubric(RubricWriter *rw, SharedArea *sh, bool force) {
+    pump_rubric_save(rw, sh, force);
+    if (rw->step != SAVE_IDLE || !sh->rubric_dirty.load()) {
+        return -1;
+    }
+
+    int64_t due = rw->last_save_ms + rw->interval_ms;
+    int64_t now = now_us() / 1000;
+    if (!force && now < due) {
+        return sh->simulate ? -1 : static_cast<int>(due - now);
+    }
+
+    // Snapshot and mark clean; a later correction re-dirties and wakes us
+    std::vector<char> snapshot(sh->num_questions);
+    sh->rubric_dirty.store(0);
+    read_rubric_snapshot(sh, snapshot.data());
+
+    log_parent(sh, EV_RUBRIC_SAVING);
+    rw->last_save_ms = now;
+    rw->trace_t0 = trace_clock(sh);
+    start_rubric_save(rw, snapshot.data(), sh->num_questions);
+    pump_rubric_save(rw, sh, force);
+    if (rw->step == SAVE_IDLE && sh->rubric_dirty.load()) {
+        return rw->interval_ms; // failed at once
+    }
+    return -1;
+}
+
+// One exam file, read ahead of the ring by the exam reader
+struct ExamFile {
+    std::string name;           // file name inside the exam directory
+    char student_id[5];         // first line, "0001" - 4 digits + '\0'
+    uint64_t pos;               // input position after this exam (1-based index)
+    ExamMeta meta;              // its header lines (see exam_batch.h)
+};
+
+// Parent-side exam ingestion. The exam directory is listed once, sorted
+// in natural order (exam2.txt before exam10.txt); with --watch, exam files
+// that appear later are appended as inotify reports them. Once started,
+// a reader thread keeps up to prefetch exams read ahead in ready, so the
+// parent never opens a file between "exam done" and refilling the ring;
+// it reads them through AsyncIo, all prefetch of them at once.
+// If exam_dir is a packed batch (pack_exams) it is mapped instead and
+// exams are taken straight from the mapping, no reader needed.
+struct ExamSource {
+    const char *dir;
+    SharedArea *sh;
+    int  prefetch;                      // K exams read ahead
+    int  io_backend;                    // IoBackend the reader thread uses
+    int  watch_fd;                      // inotify descriptor, or -1
+    std::vector<std::string> names;     // listing, in load order
+    size_t next_name;                   // first entry not read yet
+    std::unordered_set<std::string> seen;
+    const char *batch;                  // mapped batch, or nullptr
+    size_t      batch_size;
+    uint32_t    batch_count;
+    uint32_t    next_rec;               // first batch record not taken yet
+
+    // Shared between the reader thread and the parent
+    std::mutex              mu;
+    std::condition_variable room;       // reader waits for ready to shrink
+    std::deque<ExamFile>    ready;
+    bool                    eof;        // reader hit the end of input
+    bool                    stop;       // parent asks the reader to quit
+    std::thread             reader;     // not started: the parent reads inline
+};
+
+/**
+ * Map the packed batch at path into src, read-only, and check its header
+ * and every record up front, so a bad batch is refused before any exam is
+ * loaded rather than partway through the run.
+ * Returns 0 on success, -1 (after printing why) otherwise.
+ */
+static int map_exam_batch(ExamSource *src, const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        std::perror(path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    void *mem = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (mem == MAP_FAILED) {
+        std::perror("mmap exam batch");
+        return -1;
+    }
+    const char *err = exam_batch_check(static_cast<const char *>(mem), size);
+    if (err) {
+        std::fprintf(stderr, "%s: %s\n", path, err);
+        munmap(mem, size);
+        return -1;
+    }
+    uint32_t count = reinterpret_cast<const ExamBatchHeader *>(mem)->count;
+    for (uint32_t i = 0; i < count; i++) {
+        if (!exam_batch_record(static_cast<const char *>(mem), size, i)) {
+            std::fprintf(stderr, "%s: record %u is truncated or corrupt\n", path, i + 1);
+            munmap(mem, size);
+            return -1;
+        }
+    }
+    madvise(mem, size, MADV_WILLNEED); // read ahead the whole batch
+
+    src->batch       = static_cast<const char *>(mem);
+    src->batch_size  = size;
+    src->batch_count = count;
+    return 0;
+}
+
+/**
+ * Set up src for exam_dir. A regular file is taken as a packed batch.
+ * For a directory, start the inotify watch first (if requested) so no
+ * file slips in between listing and watching, then list the directory.
+ * Returns 0 on success, -1 (after printing why) if it cannot be read.
+ */
+static int open_exam_source(ExamSource *src, const char *exam_dir, SharedArea *sh,
+                            int prefetch, bool watch) {
+    src->dir        = exam_dir;
+    src->sh         = sh;
+    src->prefetch   = prefetch;
+    src->watch_fd   = -1;
+    src->next_name  = 0;
+    src->eof        = false;
+    src->stop       = false;
+    src->batch      = nullptr;
+    src->next_rec   = 0;
+    src->io_backend = IO_SYNC;
+
+    struct stat st;
+    if (stat(exam_dir, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (watch) {
+            std::fprintf(stderr, "--watch needs an exam directory, not a batch\n");
+            return -1;
+        }
+        return map_exam_batch(src, exam_dir);
+    }
+
+    if (watch) {
+        src->watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (src->watch_fd < 0 ||
+            inotify_add_watch(src->watch_fd, exam_dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+            std::perror("inotify");
+            if (src->watch_fd >= 0) {
+                close(src->watch_fd);
+            }
+            return -1;
+        }
+    }
+
+    if (list_exam_dir(exam_dir, &src->names) != 0) {
+        std::perror("opendir exam_dir");
+        return -1;
+    }
+    src->seen.insert(src->names.begin(), src->names.end());
+    return 0;
+}
+
+/**
+ * --watch: wait (up to timeout_ms) for new exam files and append them to
+ * the listing, each batch in natural order. Returns true if any arrived.
+ */
+static bool watch_exam_dir(ExamSource *src, int timeout_ms) {
+    struct pollfd pfd = {src->watch_fd, POLLIN, 0};
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return false;
+    }
+
+    alignas(struct inotify_event) char buf[4096];
+    size_t before = src->names.size();
+    ssize_t len;
+    while ((len = read(src->watch_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = reinterpret_cast<struct inotify_event *>(p);
+            if (ev->len > 0 && is_exam_name(ev->name) &&
+                src->seen.insert(ev->name).second) {
+                src->names.push_back(ev->name);
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+    sort_exam_names(src->names.begin() + before, src->names.end());
+    return src->names.size() > before;
+}
+
+/**
+ * Take the next name in the listing into out (name and input position).
+ * At the end of the listing, with --watch and block set, waits for new
+ * files until stop is requested.
+ *
+ * Returns 1 if out holds a name, 0 if none is available yet (--watch),
+ * -1 at the end of input.
+ */
+static int next_exam_name(ExamSource *src, ExamFile *out, bool block) {
+    while (src->next_name == src->names.size()) {
+        if (src->watch_fd < 0) {
+            return -1;
+        }
+        if (!watch_exam_dir(src, block ? 100 : 0)) {
+            if (!block) {
+                return 0;
+            }
+            std::lock_guard<std::mutex> lk(src->mu);
+            if (src->stop) {
+                return -1;
+            }
+        }
+    }
+    out->name = src->names[src->next_name++];
+    out->pos  = src->next_name;
+    return 1;
+}
+
+/**
+ * Read the next exam in the listing into out. Files that cannot be read
+ * or are empty are reported and skipped. At the end of the listing, with
+ * --watch and block set, waits for new files until stop is requested.
+ *
+ * Returns 1 if out holds an exam, 0 if none is available yet (--watch),
+ * -1 at the end of input.
+ */
+static int read_next_exam(ExamSource *src, ExamFile *out, bool block) {
+    if (src->batch) {
+        if (src->next_rec == src->batch_count) {
+            return -1;
+        }
+        // Every record was checked by map_exam_batch()
+        const ExamRecord *r = exam_batch_record(src->batch, src->batch_size,
+                                                src->next_rec++);
+        out->name.assign(exam_record_name(r), r->name_len);
+        std::memcpy(out->student_id, r->student_id, 4);
+        out->student_id[4] = '\0';
+        out->pos = src->next_rec;
+        parse_exam_header(exam_record_text(r), r->text_len, &out->meta);
+        return 1;
+    }
+
+    while (true) {
+        int rc = next_exam_name(src, out, block);
+        if (rc <= 0) {
+            return rc;
+        }
+        std::string path = std::string(src->dir) + "/" + out->name;
+        FILE *f = std::fopen(path.c_str(), "r");
+        if (!f) {
+            std::perror("fopen exam");
+            continue;
+        }
+        char line[EXAM_HEADER_MAX];
+        size_t len = std::fread(line, 1, sizeof(line), f);
+        std::fclose(f);
+        if (len == 0) {
+            std::fprintf(stderr, "Empty exam file: %s\n", path.c_str());
+            continue;
+        }
+
+        // Take the first 4 chars as student ID
+        std::memcpy(out->student_id, line, 4);
+        out->student_id[4] = '\0';
+        parse_exam_header(line, len, &out->meta);
+        return 1;
+    }
+}
+
+#define EXAM_READ_WORKERS 8     // IO_THREADS: files the reader opens at once
+
+// One exam file the reader has in flight: opened, its first line read, then
+// closed, one AsyncIo op at a time
+struct ExamRead {
+    ExamFile    ef;
+    std::string path;
+    IoOp        op;
+    int         fd;
+    int         len;            // bytes read, or -errno if open or read failed
+    bool        done;           // closed (or never opened)
+    char        line[EXAM_HEADER_MAX];
+};
+
+/**
+ * Reader: exam read r finished op; start its next step.
+ */
+static void advance_exam_read(AsyncIo *io, ExamRead *r, const IoOp *op) {
+    switch (op->opcode) {
+    case IOP_OPEN:
+        if (op->res < 0) {
+            r->len  = op->res;
+            r->done = true;
+            return;
+        }
+        r->fd        = op->res;
+        r->op        = io_op(IOP_READ, r->fd, r);
+        r->op.buf    = r->line;
+        r->op.len    = sizeof(r->line);
+        r->op.off    = 0;
+        async_io_submit(io, &r->op);
+        return;
+    case IOP_READ:
+        r->len = op->res;
+        r->op  = io_op(IOP_CLOSE, r->fd, r);
+        async_io_submit(io, &r->op);
+        return;
+    default:
+        r->done = true;
+        return;
+    }
+}
+
+/**
+ * Reader thread: keep up to prefetch exams read ahead, waking the parent
+ * whenever one becomes ready. The files are read through AsyncIo with all
+ * of them in flight at once, so a slow disk costs about one round trip per
+ * prefetch exams instead of one per exam; they still become ready in
+ * listing order. Stops after the sentinel or end of input.
+ */
+static void exam_reader(ExamSource *src) {
+    AsyncIo io;
+    async_io_open(&io, src->io_backend, std::min(src->prefetch, EXAM_READ_WORKERS),
+                  nullptr, nullptr, nullptr);
+    size_t window = std::min(src->prefetch, ASYNC_IO_ENTRIES);
+    std::deque<std::unique_ptr<ExamRead>> reads;    // in flight, in listing order
+    std::vector<IoOp *> done;
+    bool end = false;   // no more files to start: end of input, sentinel or stop
+
+    while (!end || !reads.empty()) {
+        // Start reading more exams while there is room (with nothing in
+        // flight, wait for room or new files)
+        while (!end) {
+            {
+                std::unique_lock<std::mutex> lk(src->mu);
+                if (reads.empty()) {
+                    src->room.wait(lk, [src] {
+                        return src->stop ||
+                               static_cast<int>(src->ready.size()) < src->prefetch;
+                    });
+                }
+                if (src->stop) {
+                    end = true;
+                    break;
+                }
+                if (src->ready.size() + reads.size() >= static_cast<size_t>(src->prefetch) ||
+                    reads.size() >= window) {
+                    break;
+                }
+            }
+            std::unique_ptr<ExamRead> r(new ExamRead());
+            int rc = next_exam_name(src, &r->ef, reads.empty());
+            if (rc < 0) {
+                end = true;
+                break;
+            } else if (rc == 0) {
+                break;
+            }
+            r->path     = std::string(src->dir) + "/" + r->ef.name;
+            r->op       = io_op(IOP_OPEN, -1, r.get());
+            r->op.path  = r->path.c_str();
+            r->op.flags = O_RDONLY;
+            async_io_submit(&io, &r->op);
+            reads.push_back(std::move(r));
+        }
+
+        // Move reads along; once the front ones are done, hand them over
+        done.clear();
+        async_io_reap(&io, &done, true);
+        for (IoOp *op : done) {
+            advance_exam_read(&io, static_cast<ExamRead *>(op->user), op);
+        }
+        bool wake = false;
+        {
+            std::lock_guard<std::mutex> lk(src->mu);
+            while (!reads.empty() && reads.front()->done) {
+                std::unique_ptr<ExamRead> r = std::move(reads.front());
+                reads.pop_front();
+                if (src->eof) {
+                    continue; // read ahead of the sentinel, not needed
+                }
+                if (r->len <= 0) {
+                    if (r->len < 0) {
+                        std::fprintf(stderr, "%s: %s\n", r->path.c_str(), std::strerror(-r->len));
+                    } else {
+                        std::fprintf(stderr, "Empty exam file: %s\n", r->path.c_str());
+                    }
+                    continue;
+                }
+                // Take the first 4 chars as student ID
+                std::memcpy(r->ef.student_id, r->line, 4);
+                r->ef.student_id[4] = '\0';
+                parse_exam_header(r->line, r->len, &r->ef.meta);
+                src->ready.push_back(r->ef);
+                wake = true;
+                if (std::strncmp(r->ef.student_id, "9999", 4) == 0) {
+                    src->eof = true;
+                    end = true;
+                }
+            }
+            if (end && reads.empty() && !src->eof) {
+                src->eof = true;
+                wake = true;
+            }
+        }
+        if (wake) {
+            post_event(src->sh, WAIT_PARENT);
+        }
+    }
+    async_io_close(&io);
+}
+
+/**
+ * Parent: start the reader thread, issuing its reads through io_backend.
+ * Until then take_exam() reads inline, which is also what --simulate
+ * keeps doing so runs stay deterministic.
+ */
+static int start_exam_reader(ExamSource *src, int io_backend) {
+    src->io_backend = io_backend;
+    try {
+        src->reader = std::thread(exam_reader, src);
+    } catch (const std::system_error &e) {
+        std::fprintf(stderr, "exam reader thread: %s\n", e.what());
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Parent: stop and join the reader thread, close the watch and unmap the
+ * batch. Call only once the TAs are gone, they may still be looking at
+ * batch records.
+ */
+static void close_exam_source(ExamSource *src) {
+    if (src->reader.joinable()) {
+        {
+            std::lock_guard<std::mutex> lk(src->mu);
+            src->stop = true;
+        }
+        src->room.notify_one();
+        src->reader.join();
+    }
+    if (src->watch_fd >= 0) {
+        close(src->watch_fd);
+    }
+    if (src->batch) {
+        munmap(const_cast<char *>(src->batch), src->batch_size);
+    }
+}
+
+/**
+ * Parent: take the next exam. Returns 1 with out filled, 0 if the reader
+ * has not got it yet (it posts parent_wake when it has), -1 at the end of
+ * input.
+ */
+static int take_exam(ExamSource *src, ExamFile *out) {
+    if (!src->reader.joinable()) {
+        return read_next_exam(src, out, false);
+    }
+    std::lock_guard<std::mutex> lk(src->mu);
+    if (src->ready.empty()) {
+        return src->eof ? -1 : 0;
+    }
+    *out = src->ready.front();
+    src->ready.pop_front();
+    src->room.notify_one();
+    return 1;
+}
+
+/**
+ * Load exam ef, the idx-th exam (1-based), into the ring slot for exam
+ * number seq.
+ *
+ * The slot is not visible to TAs until the caller queues its questions
+ * with push_exam(), so no lock is needed here.
+ *
+ * Returns 0 on success, 1 if this is the sentinel student 9999 (nothing
+ * to mark).
+ */
+static int load_exam(const ExamFile *ef, int idx, SharedArea *sh, int seq) {
+    ExamSlot *slot = exam_slot(sh, seq);
+    std::memcpy(slot->student_id, ef->student_id, sizeof(slot->student_id));
+
+    log_parent(sh, EV_EXAM_LOADED, slot->student_id, idx, ef->name.c_str());
+
+    // Sentinel student: stop loading, TAs exit once the ring drains
+    if (std::strncmp(slot->student_id, "9999", 4) == 0) {
+        log_parent(sh, EV_SENTINEL);
+        return 1;
+    }
+
+    // Reset question and review states
+    int *state = question_states(sh, seq);
+    int *review = review_states(sh, seq);
+    for (int i = 0; i < sh->num_questions; i++) {
+        state[i] = 0;
+        review[i] = 0;
+    }
+    slot->questions_left.store(sh->num_questions, std::memory_order_relaxed);
+    slot->exam_done.store(0, std::memory_order_relaxed);
+    slot->reviews_left.store(sh->review_policy == REVIEW_PARTITIONED ? sh->num_questions : -1,
+                             std::memory_order_relaxed);
+
+    return 0;
+}
+
+/**
+ * Parent: the deque exam seq is dealt to: TA seq % num_TAs, or the next
+ * slot after it that is in the pool, so new exams are dealt round-robin
+ * over the running TAs.
+ */
+static int deal_target(SharedArea *sh, int seq) {
+    for (int k = 0; k < sh->num_TAs; k++) {
+        int ta = (seq + k) % sh->num_TAs;
+        if (ta_slot(sh, ta)->active.load(std::memory_order_relaxed)) {
+            return ta;
+        }
+    }
+    return seq % sh->num_TAs; // nobody running: any TA started later steals it
+}
+
+/**
+ * Append count items of kind for exam seq, questions from first on, to the
+ * tail of TA ta's deque. actor is who is pushing: -1 for the parent, or a
+ * TA releasing an exam's questions after the last rubric check.
+ */
+static void push_items(SharedArea *sh, int actor, int ta, int seq, int first, int count,
+                       int kind) {
+    WorkDeque *d = work_deque(sh, ta);
+    lock_sem(sh, &d->lock, actor);
+    if (actor >= 0) {
+        ta_slot(sh, actor)->held_lock.store(ta, std::memory_order_relaxed);
+    }
+    int tail = d->tail.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        *deque_item(sh, d, tail + i) = {seq, first + i, kind};
+    }
+    d->tail.store(tail + count, std::memory_order_release);
+    sh->queued.fetch_add(count, std::memory_order_release);
+    if (actor >= 0) {
+        ta_slot(sh, actor)->held_lock.store(HELD_NONE, std::memory_order_relaxed);
+    }
+    sem_post(&d->lock);
+}
+
+/**
+ * Parent: queue exam seq on one TA's deque: every question, or with
+ * --review=partitioned every rubric entry to check first.
+ */
+static void push_exam(SharedArea *sh, int seq) {
+    int kind = WORK_MARK;
+    if (sh->review_policy == REVIEW_PARTITIONED) {
+        kind = WORK_REVIEW;
+        sh->reviews_open.fetch_add(1, std::memory_order_acq_rel);
+    }
+    push_items(sh, -1, deal_target(sh, seq), seq, 0, sh->num_questions, kind);
+}
+
+/**
+ * TA: hand back stop tokens that were taken while a review was out, so the
+ * TAs that took them look again once its questions are queued.
+ */
+static void return_stops(SharedArea *sh) {
+    int n = sh->stops_held.exchange(0, std::memory_order_acq_rel);
+    for (int i = 0; i < n; i++) {
+        post_event(sh, WAIT_WORK);
+    }
+}
+
+/**
+ * --review=partitioned: every rubric entry has been checked for exam seq;
+ * queue its questions for marking and wake a TA per question. Called by
+ * the TA that checked the last entry (or the supervisor if it died there).
+ * Stop tokens taken while the review was out are handed back.
+ */
+static void release_exam(SharedArea *sh, int actor, int seq) {
+    push_items(sh, actor, deal_target(sh, seq), seq, 0, sh->num_questions, WORK_MARK);
+    exam_slot(sh, seq)->reviews_left.store(-1, std::memory_order_relaxed);
+    for (int i = 0; i < sh->num_questions; i++) {
+        post_event(sh, WAIT_WORK);
+    }
+    sh->reviews_open.fetch_sub(1, std::memory_order_acq_rel);
+    return_stops(sh);
+}
+
+/**
+ * TA: take one work item, from the head of its own deque if it has one,
+ * otherwise by stealing from the tail of the next non-empty deque after
+ * its own. The item is published in the TA's slot (PH_ITEM) before the
+ * deque lock is released, so the supervisor can requeue it if the TA dies.
+ * Returns false if every deque was empty.
+ */
+static bool take_work(SharedArea *sh, int ta_id, WorkItem *item, TaStats *stats) {
+    TaSlot *me = ta_slot(sh, ta_id);
+    for (int k = 0; k < sh->num_TAs; k++) {
+        int victim = (ta_id + k) % sh->num_TAs;
+        WorkDeque *d = work_deque(sh, victim);
+        if (d->head.load(std::memory_order_relaxed) ==
+            d->tail.load(std::memory_order_acquire)) {
+            continue; // empty, don't bother locking
+        }
+
+        lock_sem(sh, &d->lock, ta_id);
+        me->held_lock.store(victim, std::memory_order_relaxed);
+        int head = d->head.load(std::memory_order_relaxed);
+        int tail = d->tail.load(std::memory_order_relaxed);
+        if (head == tail) {
+            me->held_lock.store(HELD_NONE, std::memory_order_relaxed);
+            sem_post(&d->lock); // emptied while we waited
+            continue;
+        }
+        if (k == 0) {
+            *item = *deque_item(sh, d, head);
+            d->head.store(head + 1, std::memory_order_relaxed);
+        } else {
+            *item = *deque_item(sh, d, tail - 1);
+            d->tail.store(tail - 1, std::memory_order_relaxed);
+            metric_add(stats->steals, 1);
+        }
+        sh->queued.fetch_sub(1, std::memory_order_acq_rel);
+        me->item_seq.store(item->seq, std::memory_order_relaxed);
+        me->item_q.store(item->q, std::memory_order_relaxed);
+        me->item_kind.store(item->kind, std::memory_order_relaxed);
+        me->phase.store(PH_ITEM, std::memory_order_release);
+        me->held_lock.store(HELD_NONE, std::memory_order_relaxed);
+        sem_post(&d->lock);
+        return true;
+    }
+    return false;
+}
+
+// One exam that was in flight when the previous run stopped
+struct ResumedExam {
+    uint64_t pos;                   // input position after it
+    char student_id[5];
+    std::vector<uint8_t> done;      // per question: marked already
+};
+
+// Parent-side state of --persist: the checkpoint file and what the
+// previous run left in it (see checkpoint.h)
+struct Persist {
+    const char *path;
+    int         fd;                 // open (and flock'ed) for the whole run
+    size_t      size;
+    int64_t     retired;            // exams finished by previous runs
+    uint64_t    resume_pos;         // every exam up to this input position is done
+    uint64_t    check_pos;          // the last of them retired, named last_name
+    std::string last_name;
+    uint64_t    done_after[CHECKPOINT_WINDOW / 64]; // exams done past resume_pos
+    uint64_t    rubric_version;
+    bool        rubric_changed;     // checkpoint rubric is newer than the file
+    uint64_t    results_size;       // --results bytes committed by previous runs
+    int         old_shmid;          // segment of the previous run, or -1
+    std::vector<ResumedExam> in_flight;
+};
+
+/**
+ * Copy what a previous run left in the checkpoint ck (of file size size)
+ * into ps, if it belongs to this input and rubric. Returns 0 if it does,
+ * -1 (after printing why) otherwise.
+ */
+static int read_checkpoint(Persist *ps, const CheckpointHeader *ck, size_t size,
+                           const std::string &source, std::vector<char> *rubric) {
+    CheckpointHeader *h = const_cast<CheckpointHeader *>(ck);
+    if (size < sizeof(CheckpointHeader) ||
+        std::memcmp(h->magic, CHECKPOINT_MAGIC, 8) != 0 ||
+        h->version != CHECKPOINT_VERSION || h->size != size ||
+        h->num_questions > MAX_QUESTIONS || h->ring_slots < 1 ||
+        size != checkpoint_size(h->num_questions, h->ring_slots)) {
+        std::fprintf(stderr, "%s is not a marker checkpoint (or a different version)\n",
+                     ps->path);
+        return -1;
+    }
+    if (static_cast<size_t>(h->num_questions) != rubric->size() ||
+        source.compare(0, CHECKPOINT_NAME_MAX - 1, h->exam_source) != 0) {
+        std::fprintf(stderr, "%s belongs to a run over %s with %u questions;"
+                             " remove it to start over\n",
+                     ps->path, h->exam_source, h->num_questions);
+        return -1;
+    }
+
+    ps->old_shmid = h->shmid;
+    const CheckpointProgress *p = &h->progress[h->current.load() & 1];
+    ps->retired        = p->retired;
+    ps->resume_pos     = p->resume_pos;
+    ps->check_pos      = p->check_pos;
+    std::memcpy(ps->done_after, p->done_after, sizeof(ps->done_after));
+    ps->last_name.assign(p->last_name, strnlen(p->last_name, CHECKPOINT_NAME_MAX));
+    ps->rubric_version = h->rubric_version.load();
+    ps->results_size   = h->results_size.load();
+    if (ps->rubric_version > 0) {
+        for (size_t q = 0; q < rubric->size(); q++) {
+            char c = checkpoint_rubric(h)[q].load();
+            ps->rubric_changed |= (c != (*rubric)[q]);
+            (*rubric)[q] = c;
+        }
+    }
+    for (uint32_t i = 0; i < h->ring_slots; i++) {
+        CheckpointSlot *cs = checkpoint_slot(h, i);
+        uint64_t pos = cs->pos.load();
+        if (pos <= ps->resume_pos) {
+            continue; // free, or retired just before the stop
+        }
+        ResumedExam re;
+        re.pos = pos;
+        std::memcpy(re.student_id, cs->student_id, 4);
+        re.student_id[4] = '\0';
+        re.done.resize(h->num_questions);
+        for (uint32_t q = 0; q < h->num_questions; q++) {
+            re.done[q] = checkpoint_done(cs)[q].load();
+        }
+        ps->in_flight.push_back(std::move(re));
+    }
+    return 0;
+}
+
+/**
+ * --persist: open (or create) the checkpoint at ps->path for exams from
+ * exam_dir. If a previous run left one for the same input, take its
+ * progress into ps and its rubric into *rubric (it has every correction,
+ * the rubric file may be one write-behind interval older). Then lay the
+ * file out afresh for this run, keeping that progress, and map it.
+ * Returns 0 on success, -1 (after printing why) otherwise.
+ */
+static int open_checkpoint(Persist *ps, const char *exam_dir, int ring_slots,
+                           std::vector<char> *rubric) {
+    ps->retired = 0;
+    ps->resume_pos = 0;
+    ps->check_pos = 0;
+    std::memset(ps->done_after, 0, sizeof(ps->done_after));
+    ps->rubric_version = 0;
+    ps->rubric_changed = false;
+    ps->results_size = 0;
+    ps->old_shmid = -1;
+
+    char *real = realpath(exam_dir, nullptr);
+    if (!real) {
+        std::perror(exam_dir);
+        return -1;
+    }
+    std::string source(real);
+    std::free(real);
+
+    ps->fd = open(ps->path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (ps->fd < 0) {
+        std::perror(ps->path);
+        return -1;
+    }
+    // The TAs of a run that just crashed may take a moment to die and let go
+    int tries = 0;
+    while (flock(ps->fd, LOCK_EX | LOCK_NB) != 0) {
+        if (errno != EWOULDBLOCK || ++tries == 20) {
+            std::fprintf(stderr, "%s is in use by another marker\n", ps->path);
+            return -1;
+        }
+        usleep(50 * 1000);
+    }
+    struct stat st;
+    if (fstat(ps->fd, &st) != 0) {
+        std::perror(ps->path);
+        return -1;
+    }
+    if (st.st_size > 0) {
+        size_t old_size = static_cast<size_t>(st.st_size);
+        void *old = mmap(nullptr, old_size, PROT_READ, MAP_SHARED, ps->fd, 0);
+        if (old == MAP_FAILED) {
+            std::perror("mmap checkpoint");
+            return -1;
+        }
+        int rc = read_checkpoint(ps, static_cast<const CheckpointHeader *>(old), old_size,
+                                 source, rubric);
+        munmap(old, old_size);
+        if (rc != 0) {
+            return -1;
+        }
+    }
+
+    int num_questions = static_cast<int>(rubric->size());
+    ps->size = checkpoint_size(num_questions, ring_slots);
+    if (ftruncate(ps->fd, static_cast<off_t>(ps->size)) != 0) {
+        std::perror("ftruncate checkpoint");
+        return -1;
+    }
+    void *mem = mmap(nullptr, ps->size, PROT_READ | PROT_WRITE, MAP_SHARED, ps->fd, 0);
+    if (mem == MAP_FAILED) {
+        std::perror("mmap checkpoint");
+        return -1;
+    }
+
+    // Progress first (into the spare record), then the rest: a crash in
+    // between still finds the progress
+    CheckpointHeader *ck = static_cast<CheckpointHeader *>(mem);
+    uint32_t next = (st.st_size > 0) ? (ck->current.load() ^ 1) & 1 : 0;
+    CheckpointProgress *p = &ck->progress[next];
+    p->retired    = ps->retired;
+    p->resume_pos = ps->resume_pos;
+    p->check_pos  = ps->check_pos;
+    std::snprintf(p->last_name, sizeof(p->last_name), "%s", ps->last_name.c_str());
+    std::memcpy(p->done_after, ps->done_after, sizeof(p->done_after));
+    ck->current.store(next, std::memory_order_release);
+
+    std::memcpy(ck->magic, CHECKPOINT_MAGIC, 8);
+    ck->version       = CHECKPOINT_VERSION;
+    ck->num_questions = num_questions;
+    ck->ring_slots    = ring_slots;
+    ck->shmid         = -1;
+    ck->size          = ps->size;
+    std::snprintf(ck->exam_source, sizeof(ck->exam_source), "%s", source.c_str());
+    for (int q = 0; q < num_questions; q++) {
+        checkpoint_rubric(ck)[q].store((*rubric)[q], std::memory_order_relaxed);
+    }
+    ck->rubric_version.store(ps->rubric_version, std::memory_order_relaxed);
+    ck->results_size.store(ps->results_size, std::memory_order_relaxed);
+    for (int i = 0; i < ring_slots; i++) {
+        checkpoint_slot(ck, i)->pos.store(0, std::memory_order_relaxed);
+    }
+    g_ckpt = ck;
+    return 0;
+}
+
+/**
+ * --persist: remove the segment a crashed previous run left behind, if
+ * shmid still is that segment: a marker segment nobody is attached to,
+ * whose parent is gone.
+ */
+static void remove_stale_area(int shmid) {
+    struct shmid_ds ds;
+    if (shmid < 0 || shmctl(shmid, IPC_STAT, &ds) != 0 || ds.shm_nattch != 0 ||
+        ds.shm_perm.uid != getuid() || ds.shm_segsz < sizeof(SharedArea)) {
+        return;
+    }
+    void *mem = shmat(shmid, nullptr, SHM_RDONLY);
+    if (mem == reinterpret_cast<void *>(-1)) {
+        return;
+    }
+    const SharedArea *old = static_cast<const SharedArea *>(mem);
+    bool stale = old->magic == SHARED_AREA_MAGIC &&
+                 kill(old->parent_pid, 0) != 0 && errno == ESRCH;
+    shmdt(mem);
+    if (stale) {
+        shmctl(shmid, IPC_RMID, nullptr);
+    }
+}
+
+/**
+ * Parent, at the end of a run: unmap the checkpoint, and remove it if
+ * every exam got marked (a later run starts afresh).
+ */
+static void close_checkpoint(Persist *ps, bool complete) {
+    munmap(g_ckpt, ps->size);
+    g_ckpt = nullptr;
+    if (complete) {
+        unlink(ps->path);
+    }
+    close(ps->fd);
+}
+
+/**
+ * Skip the first resume_pos entries of the input (done by previous runs),
+ * after checking entry check_pos is still the exam they last retired
+ * there. Returns 0 on success, -1 (after printing why) if the input has
+ * changed.
+ */
+static int seek_exam_source(ExamSource *src, const Persist *ps) {
+    uint64_t pos = ps->check_pos;
+    if (ps->resume_pos == 0) {
+        return 0;
+    }
+    uint64_t count = src->batch ? src->batch_count : src->names.size();
+    std::string at;
+    if (pos == 0) {
+        at = ps->last_name; // nothing retired yet, only unreadable files skipped
+    } else if (src->batch) {
+        const ExamRecord *r = (pos <= src->batch_count)
+            ? exam_batch_record(src->batch, src->batch_size, static_cast<uint32_t>(pos - 1))
+            : nullptr;
+        if (r) {
+            at.assign(exam_record_name(r), r->name_len);
+        }
+    } else if (pos <= src->names.size()) {
+        at = src->names[pos - 1];
+    }
+    if (at.substr(0, CHECKPOINT_NAME_MAX - 1) != ps->last_name ||
+        ps->resume_pos > count) {
+        std::fprintf(stderr, "%s: the exams have changed since the checkpoint (entry %llu"
+                             " was %s); remove it to start over\n", ps->path,
+                     static_cast<unsigned long long>(pos), ps->last_name.c_str());
+        return -1;
+    }
+    if (src->batch) {
+        src->next_rec = static_cast<uint32_t>(ps->resume_pos);
+    } else {
+        src->next_name = ps->resume_pos;
+    }
+    return 0;
+}
+
+/**
+ * Parent: exam ef is now in slot seq; note it in the checkpoint with no
+ * questions done.
+ */
+static void checkpoint_loaded(SharedArea *sh, int seq, const ExamFile *ef) {
+    if (!g_ckpt) {
+        return;
+    }
+    CheckpointSlot *cs = checkpoint_slot(g_ckpt, seq % sh->ring_slots);
+    for (int q = 0; q < sh->num_questions; q++) {
+        checkpoint_done(cs)[q].store(0, std::memory_order_relaxed);
+    }
+    std::memcpy(cs->student_id, ef->student_id, sizeof(ef->student_id));
+    std::snprintf(cs->name, sizeof(cs->name), "%s", ef->name.c_str());
+    cs->pos.store(ef->pos, std::memory_order_release);
+}
+
+// --schedule: which exam of the window is loaded next
+enum SchedulePolicy { ORDER_FIFO, ORDER_PRIORITY, ORDER_EDF };
+
+// An exam taken from the input: waiting in the window, or loaded
+struct QueuedExam {
+    ExamFile ef;
+    int64_t  queued_us;         // clock_us() when it was taken from the input
+};
+
+// Finished exams of one priority class, for the report
+struct ClassStats {
+    std::vector<int64_t> latencies;     // taken-to-done
+    int deadlines;                      // exams that had one
+    int missed;
+};
+
+// Parent-side exam scheduler. Exams are taken from the input into a window
+// of up to --prefetch of them and loaded into the ring in policy order.
+// None is loaded more than CHECKPOINT_WINDOW input positions past the
+// first exam not done yet, which bounds how long an exam can be passed
+// over and keeps the out-of-order progress within what the checkpoint
+// holds.
+struct Scheduler {
+    int     policy;             // SchedulePolicy
+    size_t  window;
+    int64_t origin_us;          // deadlines count from here
+    double  deadline_scale;     // --delay-scale, which deadlines follow too
+    const std::unordered_map<std::string, ExamMeta> *manifest;
+    std::vector<QueuedExam> pending;
+    std::vector<QueuedExam> in_ring;    // by seq % ring_slots
+    bool     input_end;         // nothing more to take
+    bool     have_sentinel;
+    ExamFile sentinel;          // loaded once the window has emptied
+
+    // Input positions: every exam up to done_upto is done (retired, done by
+    // a previous run, or unreadable); open are those taken, not retired
+    uint64_t taken_upto;
+    uint64_t done_upto;
+    std::set<uint64_t> open;
+    std::map<uint64_t, std::string> done_after; // done past done_upto, with names
+    uint64_t check_pos;         // the last exam retired up to done_upto
+    std::string check_name;
+    int64_t  dropped;           // exams a previous run finished out of order
+    uint64_t results_upto;      // --persist with --results: the exam at retire_seq
+                                // is done once the results are committed up to
+                                // here (UINT64_MAX = not seen done yet)
+
+    std::map<int, ClassStats> classes;
+    bool has_meta;              // some exam had a priority or deadline
+};
+
+static const char *schedule_name(int policy) {
+    switch (policy) {
+    case ORDER_PRIORITY: return "priority";
+    case ORDER_EDF:      return "edf";
+    default:             return "fifo";
+    }
+}
+
+/**
+ * Parent: exam seq is retired; advance the checkpoint to the scheduler's
+ * progress and free the exam's slot there.
+ */
+static void checkpoint_retired(SharedArea *sh, int seq, const Scheduler *s) {
+    if (!g_ckpt) {
+        return;
+    }
+    CheckpointSlot *cs = checkpoint_slot(g_ckpt, seq % sh->ring_slots);
+    uint32_t next = g_ckpt->current.load(std::memory_order_relaxed) ^ 1;
+    CheckpointProgress *p = &g_ckpt->progress[next];
+    p->retired    = seq + 1 + s->dropped;
+    p->resume_pos = s->done_upto;
+    p->check_pos  = s->check_pos;
+    std::snprintf(p->last_name, sizeof(p->last_name), "%s", s->check_name.c_str());
+    std::memset(p->done_after, 0, sizeof(p->done_after));
+    for (const auto &d : s->done_after) {
+        uint64_t i = d.first - s->done_upto - 1;
+        p->done_after[i / 64] |= UINT64_C(1) << (i % 64);
+    }
+    g_ckpt->current.store(next, std::memory_order_release);
+    cs->pos.store(0, std::memory_order_release);
+}
+
+/**
+ * Parent: if exam ef, just loaded into slot seq, was in flight when the
+ * previous run stopped, mark the questions that run finished as done
+ * (here and in the checkpoint) and queue only the others. An exam with
+ * nothing left is done at once.
+ * Returns how many questions were queued, or -1 if ef was not in flight
+ * (the caller queues the whole exam).
+ */
+static int resume_exam(Persist *ps, SharedArea *sh, int seq, const ExamFile *ef) {
+    if (!ps) {
+        return -1;
+    }
+    auto it = std::find_if(ps->in_flight.begin(), ps->in_flight.end(),
+                           [ef](const ResumedExam &re) { return re.pos == ef->pos; });
+    if (it == ps->in_flight.end()) {
+        return -1;
+    }
+    ResumedExam re = std::move(*it);
+    ps->in_flight.erase(it);
+    if (std::strncmp(re.student_id, ef->student_id, 4) != 0) {
+        std::fprintf(stderr, "%s changed since the checkpoint, marking it again\n",
+                     ef->name.c_str());
+        return -1;
+    }
+
+    ExamSlot *slot = exam_slot(sh, seq);
+    int *state = question_states(sh, seq);
+    std::atomic<uint8_t> *done = checkpoint_done(checkpoint_slot(g_ckpt, seq % sh->ring_slots));
+    int left = 0;
+    for (int q = 0; q < sh->num_questions; q++) {
+        if (re.done[q]) {
+            state[q] = 2;
+            done[q].store(1, std::memory_order_relaxed);
+            log_parent(sh, EV_ALREADY_MARKED, slot->student_id, q + 1);
+        } else {
+            left++;
+        }
+    }
+    // Counted down from left, so set it before any question is queued; a
+    // resumed exam had its rubric round already
+    slot->questions_left.store(left, std::memory_order_relaxed);
+    slot->reviews_left.store(-1, std::memory_order_relaxed);
+    if (left == 0) {
+        slot->done_us = clock_us(sh);
+        trace_exam(sh, 'e', seq, slot->student_id);
+        slot->exam_done.store(1, std::memory_order_release);
+        return 0;
+    }
+    int ta = deal_target(sh, seq);
+    for (int q = 0; q < sh->num_questions; q++) {
+        if (state[q] == 0) {
+            push_items(sh, -1, ta, seq, q, 1, WORK_MARK);
+        }
+    }
+    return left;
+}
+
+/**
+ * Parent: set s up for a run with the given policy, choosing among up to
+ * window exams; a resumed run (ps) carries on from the checkpoint.
+ */
+static void init_scheduler(Scheduler *s, SharedArea *sh, int policy, int window,
+                           const std::unordered_map<std::string, ExamMeta> *manifest,
+                           const Persist *ps) {
+    s->policy         = policy;
+    s->window         = window;
+    s->origin_us      = clock_us(sh);
+    s->deadline_scale = sh->delay_scale;
+    s->manifest       = manifest;
+    s->in_ring.resize(sh->ring_slots);
+    s->input_end      = false;
+    s->have_sentinel  = false;
+    s->taken_upto     = ps ? ps->resume_pos : 0;
+    s->done_upto      = s->taken_upto;
+    s->check_pos      = ps ? ps->check_pos : 0;
+    s->check_name     = ps ? ps->last_name : "";
+    s->dropped        = 0;
+    s->results_upto   = UINT64_MAX;
+    s->has_meta       = false;
+}
+
+/**
+ * Whether a previous run (ps) finished the exam at input position pos out
+ * of order, past the position it had done everything up to.
+ */
+static bool done_before(const Persist *ps, uint64_t pos) {
+    if (!ps || pos <= ps->resume_pos) {
+        return false;
+    }
+    uint64_t i = pos - ps->resume_pos - 1;
+    return i < CHECKPOINT_WINDOW && (ps->done_after[i / 64] >> (i % 64) & 1);
+}
+
+/**
+ * Parent: move done_upto past every position that is now done, keeping
+ * the last exam retired there to check the input against on a restart.
+ */
+static void advance_done(Scheduler *s) {
+    uint64_t first_open = s->open.empty() ? s->taken_upto + 1 : *s->open.begin();
+    s->done_upto = first_open - 1;
+    while (!s->done_after.empty() && s->done_after.begin()->first <= s->done_upto) {
+        s->check_pos  = s->done_after.begin()->first;
+        s->check_name = s->done_after.begin()->second;
+        s->done_after.erase(s->done_after.begin());
+    }
+}
+
+/**
+ * Parent: top the window up with whatever the input has ready. The
+ * sentinel is held back until the window has emptied; exams a previous
+ * run finished are dropped. --manifest entries override exam headers.
+ */
+static void take_exams(Scheduler *s, ExamSource *src, SharedArea *sh, const Persist *ps) {
+    while (!s->input_end && s->pending.size() < s->window) {
+        ExamFile ef;
+        int rc = take_exam(src, &ef);
+        if (rc == 0) {
+            break;
+        }
+        if (rc < 0 || std::strncmp(ef.student_id, "9999", 4) == 0) {
+            s->have_sentinel = (rc > 0);
+            s->sentinel      = ef;
+            s->input_end     = true;
+            break;
+        }
+        s->taken_upto = ef.pos;
+        if (done_before(ps, ef.pos)) {
+            s->done_after[ef.pos] = ef.name;
+            s->dropped++;
+            continue;
+        }
+        if (s->manifest) {
+            auto it = s->manifest->find(ef.student_id);
+            if (it != s->manifest->end()) {
+                ef.meta = it->second;
+            }
+        }
+        s->has_meta |= (ef.meta.priority != 0 || ef.meta.deadline_us >= 0);
+        s->open.insert(ef.pos);
+        s->pending.push_back({ef, clock_us(sh)});
+    }
+    advance_done(s);
+}
+
+/**
+ * Whether exam a goes before exam b under policy: fifo keeps input order;
+ * priority takes the higher class first; edf the earlier deadline first,
+ * exams without one after those with one, then by class. Ties keep input
+ * order.
+ */
+static bool runs_before(int policy, const ExamFile &a, const ExamFile &b) {
+    if (policy == ORDER_EDF && a.meta.deadline_us != b.meta.deadline_us) {
+        if (a.meta.deadline_us < 0 || b.meta.deadline_us < 0) {
+            return b.meta.deadline_us < 0;
+        }
+        return a.meta.deadline_us < b.meta.deadline_us;
+    }
+    if (policy != ORDER_FIFO && a.meta.priority != b.meta.priority) {
+        return a.meta.priority > b.meta.priority;
+    }
+    return a.pos < b.pos;
+}
+
+/**
+ * Parent: the index in the window of the exam to load next, or -1 if none
+ * may be loaded yet (all too far past the first exam not done).
+ */
+static int pick_exam(const Scheduler *s) {
+    int best = -1;
+    for (size_t i = 0; i < s->pending.size(); i++) {
+        const ExamFile &ef = s->pending[i].ef;
+        if (ef.pos > s->done_upto + CHECKPOINT_WINDOW) {
+            continue;
+        }
+        if (best < 0 || runs_before(s->policy, ef, s->pending[best].ef)) {
+            best = static_cast<int>(i);
+        }
+    }
+    return best;
+}
+
+/**
+ * Parent: the exam in ring slot seq is retired (done at done_us); count it
+ * for its priority class and mark its input position done.
+ */
+static void retire_scheduled(Scheduler *s, SharedArea *sh, int seq, int64_t done_us) {
+    const QueuedExam &qe = s->in_ring[seq % sh->ring_slots];
+    ClassStats &c = s->classes[qe.ef.meta.priority];
+    c.latencies.push_back(done_us - qe.queued_us);
+    if (qe.ef.meta.deadline_us >= 0) {
+        c.deadlines++;
+        int64_t deadline = s->origin_us +
+                           static_cast<int64_t>(qe.ef.meta.deadline_us * s->deadline_scale);
+        c.missed += (done_us > deadline);
+    }
+    s->open.erase(qe.ef.pos);
+    s->done_after[qe.ef.pos] = qe.ef.name;
+    advance_done(s);
+}
+
+/**
+ * Parent: load exams until the ring is full, the input ends, or the
+ * reader has nothing ready yet.
+ * Each loaded exam is queued on one TA's deque and then one work_items
+ * token per question is posted so blocked TAs wake right away.
+ * When the input ends, every TA gets a stop token instead.
+ * Which exam is loaded next is up to the scheduler s (--schedule).
+ * With --persist (ps), questions marked before a restart are skipped.
+ */
+static void fill_ring(ExamSource *src, SharedArea *sh, Persist *ps, Scheduler *s) {
+    while (!sh->input_closed.load(std::memory_order_relaxed) &&
+           sh->load_seq - sh->retire_seq < sh->ring_slots) {
+        take_exams(s, src, sh, ps);
+        int next = pick_exam(s);
+        ExamFile ef;
+        int rc;
+        if (next >= 0) {
+            s->in_ring[sh->load_seq % sh->ring_slots] = s->pending[next];
+            ef = s->pending[next].ef;
+            s->pending.erase(s->pending.begin() + next);
+            rc = load_exam(&ef, sh->load_seq + 1, sh, sh->load_seq);
+        } else if (s->pending.empty() && s->input_end) {
+            ef = s->sentinel;
+            rc = s->have_sentinel ? load_exam(&ef, sh->load_seq + 1, sh, sh->load_seq) : -1;
+        } else {
+            break; // the reader is behind, or the first exam not done is in the ring
+        }
+
+        int tokens = sh->num_TAs;
+        if (rc == 0) {
+            exam_slot(sh, sh->load_seq)->loaded_us = clock_us(sh);
+            trace_exam(sh, 'b', sh->load_seq, ef.student_id);
+            checkpoint_loaded(sh, sh->load_seq, &ef);
+            tokens = resume_exam(ps, sh, sh->load_seq, &ef);
+            if (tokens < 0) {
+                push_exam(sh, sh->load_seq);
+                tokens = sh->num_questions;
+            }
+            sh->load_seq++;
+        } else {
+            // sentinel or end of input: no more exams will arrive
+            sh->input_closed.store(1, std::memory_order_release);
+        }
+
+        for (int i = 0; i < tokens; i++) {
+            post_event(sh, WAIT_WORK);
+        }
+    }
+}
+
+/**
+ * Parent, --persist with --results: whether the rows of the exam at
+ * retire_seq, marked done, are committed, so that the checkpoint may move
+ * past it. They all lie below the ring head as of when it was first seen
+ * done. In simulation the writer runs in real time, so the parent waits
+ * for the commit here rather than in virtual time.
+ */
+static bool results_committed(SharedArea *sh, Scheduler *s) {
+    if (!g_ckpt || !sh->results) {
+        return true;
+    }
+    ResultRing *r = result_ring(sh);
+    if (s->results_upto == UINT64_MAX) {
+        s->results_upto = r->head.load(std::memory_order_acquire);
+        r->commit_want.store(s->results_upto); // seq_cst, see commit_done()
+    }
+    while (r->committed.load() < s->results_upto) {
+        // A dead writer commits nothing more; the run fails anyway
+        int lost = sh->simulate ? check_helpers(sh)
+                                : sh->helper_lost.load(std::memory_order_acquire);
+        if (lost & HELPER_RESULTS) {
+            break;
+        }
+        if (!sh->simulate) {
+            return false; // the writer wakes the parent once it is
+        }
+        usleep(100);
+    }
+    s->results_upto = UINT64_MAX;
+    return true;
+}
+
+/**
+ * Parent: retire fully marked exams at the front of the ring so their
+ * slots can be refilled, recording each exam's load-to-done latency and
+ * how its priority class fared.
+ */
+static void retire_exams(SharedArea *sh, Scheduler *s, std::vector<int64_t> *latencies) {
+    while (sh->retire_seq < sh->load_seq &&
+           exam_slot(sh, sh->retire_seq)->exam_done.load(std::memory_order_acquire) &&
+           results_committed(sh, s)) {
+        ExamSlot *slot = exam_slot(sh, sh->retire_seq);
+        latencies->push_back(slot->done_us - slot->loaded_us);
+        retire_scheduled(s, sh, sh->retire_seq, slot->done_us);
+        checkpoint_retired(sh, sh->retire_seq, s);
+        sh->retire_seq++;
+    }
+}
+
+// What a TA remembers between rubric reviews (UINT64_MAX = never)
+struct ReviewState {
+    int exams;                      // exams it has started
+    uint64_t version;               // rubric_version when its last review began
+    std::vector<uint64_t> seen;     // per entry: stamp when it last checked it
+};
+
+/**
+ * Decide which rubric entries a TA has to check for the exam it is
+ * starting (--review), setting want[q]. Returns how many.
+ */
+static int review_wanted(SharedArea *sh, const ReviewState *rs, std::vector<char> *want) {
+    int n = 0;
+    for (int q = 0; q < sh->num_questions; q++) {
+        bool check;
+        switch (sh->review_policy) {
+        case REVIEW_CHANGED:
+            check = rubric_stamp(sh, q).load(std::memory_order_acquire) != rs->seen[q];
+            break;
+        case REVIEW_EVERY:
+            check = (rs->exams - 1) % sh->review_every == 0;
+            break;
+        default:
+            check = true;
+            break;
+        }
+        (*want)[q] = check;
+        n += check;
+    }
+    return n;
+}
+
+/**
+ * Check rubric entry q (IN SHARED MEMORY ONLY; reads are lock-free,
+ * corrections go through correct_rubric()), possibly correcting it.
+ * Returns the entry's version stamp as this TA checked it: the one it
+ * started from, or the one its own correction wrote. A correction by
+ * another TA during the check is newer, so it gets checked next time.
+ */
+static uint64_t check_rubric_entry(int ta_id, SharedArea *sh, Rng *rng, int q) {
+    TaStats *stats = ta_stats(sh, ta_id);
+
+    // Read current rubric letter (no lock needed)
+    uint64_t stamp = rubric_stamp(sh, q).load(std::memory_order_acquire);
+    char current = rubric_at(sh, q).load(std::memory_order_acquire);
+
+    log_ta(sh, ta_id, EV_RUBRIC_CHECK, nullptr, q + 1, current);
+
+    // review_delay (default 0.5–1.0 seconds) regardless of change or not
+    sleep_random_ms(sh, ta_id, rng, sh->review_delay);
+    metric_add(stats->rubric_checks, 1);
+
+    // Randomly decide whether to change this rubric entry
+    int change = rng_next(rng) >> 63;  // 0 or 1
+    if (change) {
+        char newc;
+        char old = correct_rubric(sh, ta_id, q, &newc, &stamp);
+        metric_add(stats->corrections, 1);
+        trace_instant(sh, "rubric", "correct", q + 1);
+
+        log_ta(sh, ta_id, EV_RUBRIC_CORRECT, nullptr, q + 1, old, newc);
+    } else {
+        char still = rubric_at(sh, q).load(std::memory_order_acquire);
+
+        log_ta(sh, ta_id, EV_RUBRIC_SAME, nullptr, q + 1, still);
+    }
+    return stamp;
+}
+
+/**
+ * Review the rubric before starting on a new exam. --review decides which
+ * entries: all of them, only those whose version stamp moved since this TA
+ * last checked them, or all of them every N exams. With nothing to check
+ * the TA says so and goes straight to marking.
+ */
+static void review_rubric(int ta_id, SharedArea *sh, Rng *rng, const char *student_id,
+                          ReviewState *rs) {
+    uint64_t version = sh->rubric_version.load(std::memory_order_acquire);
+    std::vector<char> want(sh->num_questions);
+    rs->exams++;
+    int n = 0;
+    if (sh->review_policy != REVIEW_CHANGED || version != rs->version) {
+        n = review_wanted(sh, rs, &want); // else nothing changed at all, no scan
+    }
+    rs->version = version;
+    if (n == 0) {
+        log_ta(sh, ta_id, EV_REVIEW_SKIPPED, nullptr, static_cast<int>(version));
+        return;
+    }
+
+    metric_set(ta_stats(sh, ta_id)->state, TA_REVIEWING);
+    int64_t trace_t0 = trace_clock(sh);
+    for (int q = 0; q < sh->num_questions; q++) {
+        if (!want[q]) {
+            continue;
+        }
+        // Its own correction does not need checking again; anyone else's does
+        rs->seen[q] = check_rubric_entry(ta_id, sh, rng, q);
+    }
+    trace_span(sh, "rubric", "review rubric", 0, trace_t0, student_id);
+}
+
+static void ta_process(int ta_id, SharedArea *sh) {
+
+    // Own random stream per TA (and per restart of its slot), derived from
+    // the run seed
+    TaSlot *me = ta_slot(sh, ta_id);
+    Rng rng;
+    rng_seed(&rng, sh->seed,
+             ta_id + me->generation.load(std::memory_order_relaxed) * sh->num_TAs);
+
+    int reviewed_seq = -1; // exam this TA last reviewed the rubric for
+    ReviewState review = {0, UINT64_MAX,
+                          std::vector<uint64_t>(sh->num_questions, UINT64_MAX)};
+    TaStats *stats = ta_stats(sh, ta_id);
+    // Idle TAs wake up to check in; the virtual clock has no supervisor
+    int wait_ms = sh->simulate ? -1 : HEARTBEAT_MS;
+
+    sim_begin(sh, ta_id);
+    trace_begin(ta_id);
+    metric_add(stats->start_us, clock_us(sh));
+    metric_set(stats->current_exam, -1);
+
+    while (true) {
+        ta_checkin(sh, ta_id, 0);
+        bool retired = me->retire.load(std::memory_order_acquire);
+
+        // Wait for a work item (no busy-wait)
+        if (!retired && sem_trywait(&sh->work_items) != 0) {
+            log_ta(sh, ta_id, EV_WAITING);
+            metric_set(stats->state, TA_WAITING);
+            int64_t t0 = clock_us(sh);
+            int64_t trace_t0 = trace_clock(sh);
+            while (wait_event(sh, ta_id, WAIT_WORK, wait_ms) != 0) {
+                ta_checkin(sh, ta_id, 0);
+                if (me->retire.load(std::memory_order_acquire)) {
+                    retired = true;
+                    break;
+                }
+            }
+            metric_add(stats->idle_us, clock_us(sh) - t0);
+            trace_span(sh, "wait", "wait for work", 0, trace_t0);
+        }
+        if (retired) {
+            log_ta(sh, ta_id, EV_TA_RETIRED);
+            break;
+        }
+        me->phase.store(PH_TOKEN, std::memory_order_release);
+
+        // Every item has its own token, so a token guarantees an item unless
+        // it is a stop token; a miss means another TA is mid-take, retry
+        WorkItem item;
+        bool stop = false;
+        while (!take_work(sh, ta_id, &item, stats)) {
+            if (sh->input_closed.load(std::memory_order_acquire) &&
+                sh->queued.load(std::memory_order_acquire) == 0) {
+                stop = true;
+                break;
+            }
+            sched_yield();
+        }
+        if (stop && sh->reviews_open.load(std::memory_order_acquire) > 0) {
+            // A review is still out and will queue its questions: keep the
+            // stop token aside and wait for them. Whoever releases the exam
+            // hands it back; if that already happened, hand it back now.
+            sh->stops_held.fetch_add(1, std::memory_order_acq_rel);
+            me->phase.store(PH_IDLE, std::memory_order_release);
+            if (sh->reviews_open.load(std::memory_order_acquire) == 0) {
+                return_stops(sh);
+            }
+            continue;
+        }
+        if (stop) {
+            me->phase.store(PH_IDLE, std::memory_order_release);
+            log_ta(sh, ta_id, EV_TA_EXIT);
+            break;
+        }
+
+        int seq = item.seq;
+        int q_to_mark = item.q;
+        ExamSlot *slot = exam_slot(sh, seq);
+        int *state = question_states(sh, seq);
+        char student_id[5];
+        std::memcpy(student_id, slot->student_id, sizeof(student_id));
+        metric_set(stats->current_exam, std::atoi(student_id));
+
+        if (seq != reviewed_seq) {
+            // New exam for this TA: review the rubric first, unless the
+            // exam's review is shared out as items (--review=partitioned)
+            log_ta(sh, ta_id, EV_START_STUDENT, student_id);
+            if (sh->review_policy != REVIEW_PARTITIONED) {
+                review_rubric(ta_id, sh, &rng, student_id, &review);
+            }
+            reviewed_seq = seq;
+        }
+
+        if (item.kind == WORK_REVIEW) {
+            // One rubric entry of this exam's review; whoever checks the
+            // last one queues the exam's questions
+            int *review_state = review_states(sh, seq);
+            review_state[q_to_mark] = 1;
+            metric_set(stats->state, TA_REVIEWING);
+            int64_t trace_t0 = trace_clock(sh);
+            check_rubric_entry(ta_id, sh, &rng, q_to_mark);
+            trace_span(sh, "rubric", "review rubric", q_to_mark + 1, trace_t0, student_id);
+            review_state[q_to_mark] = 2;
+            bool last = (slot->reviews_left.fetch_sub(1, std::memory_order_acq_rel) == 1);
+            me->phase.store(PH_COUNTED, std::memory_order_release);
+            if (last) {
+                release_exam(sh, ta_id, seq);
+                log_ta(sh, ta_id, EV_REVIEW_DONE, student_id);
+            }
+            me->phase.store(PH_IDLE, std::memory_order_release);
+            continue;
+        }
+
+        state[q_to_mark] = 1; // marking in progress
+
+        // Mark it using current rubric
+        char mark_letter = rubric_at(sh, q_to_mark).load(std::memory_order_acquire);
+
+        log_ta(sh, ta_id, EV_MARKING, student_id, q_to_mark + 1, mark_letter);
+        metric_set(stats->state, TA_MARKING);
+
+        // Marking time: mark_delay (default 1.0–2.0 seconds)
+        int64_t trace_t0 = trace_clock(sh);
+        sleep_random_ms(sh, ta_id, &rng, sh->mark_delay);
+        metric_add(stats->questions_marked, 1);
+        trace_span(sh, "mark", "mark", q_to_mark + 1, trace_t0, student_id);
+
+        // Now set the question as done and count down the exam
+        // (with --results the checkpoint has it once its row is on disk)
+        state[q_to_mark] = 2;
+        if (sh->results) {
+            record_result(sh, ta_id, seq, student_id, q_to_mark, mark_letter);
+        } else {
+            checkpoint_marked(sh, seq, q_to_mark);
+        }
+        bool last = (slot->questions_left.fetch_sub(1, std::memory_order_acq_rel) == 1);
+        me->phase.store(PH_COUNTED, std::memory_order_release);
+        if (last) {
+            slot->done_us = clock_us(sh);
+            // parent may retire and reuse the slot
+            trace_exam(sh, 'e', seq, student_id);
+            slot->exam_done.store(1, std::memory_order_release);
+            post_event(sh, WAIT_PARENT); // parent retires the slot and refills
+        }
+        me->phase.store(PH_IDLE, std::memory_order_release);
+
+        log_ta(sh, ta_id, EV_FINISHED, student_id, q_to_mark + 1);
+        if (last) {
+            log_ta(sh, ta_id, EV_EXAM_DONE, student_id);
+        }
+    }
+
+    metric_add(stats->end_us, clock_us(sh));
+    metric_set(stats->current_exam, -1);
+    metric_set(stats->state, TA_EXITED);
+    trace_end();
+    sim_leave(sh, ta_id);
+}
+
+// Parent-side view of the TA pool: which slots have a TA running, and the
+// process or thread behind each. Slots are fixed at startup (--max-tas);
+// the supervisor keeps target of them running.
+struct TaPool {
+    int  mode;                          // RunMode
+    int  shmid;                         // process mode: segment a new TA attaches
+    int  min_TAs;
+    int  target;                        // TAs the supervisor keeps running
+    std::vector<pid_t> pid;             // process mode: TA in slot i, or -1
+    std::vector<std::thread> threads;   // threads mode
+    std::vector<char> running;          // 1 = started and not reaped yet
+    std::vector<char> hung;             // hang already reported
+    std::vector<int64_t> idle_since;    // slot seen waiting since (0 = not waiting)
+};
+
+// The parent's segment, for on_sigchld()
+static SharedArea *g_parent_sh;
+
+/**
+ * SIGCHLD: wake the parent so the supervisor reaps the TA right away.
+ */
+static void on_sigchld(int) {
+    int saved = errno;
+    sem_post(&g_parent_sh->parent_wake);
+    errno = saved;
+}
+
+/**
+ * Forked child: get killed if the parent dies, instead of lingering on a
+ * semaphore nobody will post (and holding the --persist checkpoint lock).
+ */
+static void die_with_parent(pid_t parent) {
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() != parent) {
+        _exit(EXIT_FAILURE); // too late, it is gone already
+    }
+}
+
+/**
+ * Parent: starting the TA in slot i failed. It is dealt no exams, and in
+ * simulation it leaves the schedule every slot starts out in.
+ */
+static void spawn_failed(SharedArea *sh, int i) {
+    metric_set(ta_stats(sh, i)->state, TA_OFF);
+    ta_slot(sh, i)->active.store(0, std::memory_order_relaxed);
+    if (sh->simulate) {
+        sim_actor(sh, i)->state = SIM_DONE;
+    }
+}
+
+/**
+ * Parent: start a TA in free slot i. Returns 0 on success, -1 otherwise.
+ */
+static int spawn_ta(TaPool *pool, SharedArea *sh, int i) {
+    TaSlot *s = ta_slot(sh, i);
+    s->phase.store(PH_IDLE, std::memory_order_relaxed);
+    s->held_lock.store(HELD_NONE, std::memory_order_relaxed);
+    s->retire.store(0, std::memory_order_relaxed);
+    s->deadline_us.store(clock_us(sh) + HEARTBEAT_MS * 1000LL, std::memory_order_relaxed);
+    metric_set(ta_stats(sh, i)->state, TA_STARTING);
+    pool->hung[i] = 0;
+    pool->idle_since[i] = 0;
+
+    if (pool->mode == MODE_THREADS) {
+        try {
+            pool->threads[i] = std::thread(ta_process, i, sh);
+        } catch (const std::system_error &e) {
+            std::fprintf(stderr, "TA thread: %s\n", e.what());
+            spawn_failed(sh, i);
+            return -1;
+        }
+    } else {
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::perror("fork");
+            spawn_failed(sh, i);
+            return -1;
+        } else if (pid == 0) {
+            // Child TA process
+            die_with_parent(sh->parent_pid);
+            SharedArea *child_sh =
+                static_cast<SharedArea *>(shmat(pool->shmid, nullptr, 0));
+            if (child_sh == reinterpret_cast<void *>(-1)) {
+                std::perror("shmat in child");
+                std::exit(EXIT_FAILURE);
+            }
+            ta_process(i, child_sh);
+            shmdt(child_sh);
+            std::exit(EXIT_SUCCESS);
+        }
+        pool->pid[i] = pid;
+    }
+    s->active.store(1, std::memory_order_relaxed);
+    pool->running[i] = 1;
+    sh->running_TAs.fetch_add(1, std::memory_order_relaxed);
+    sh->ta_spawns.fetch_add(1, std::memory_order_relaxed);
+
+    // The stop tokens were posted when input closed; bring one for this TA
+    if (sh->input_closed.load(std::memory_order_acquire)) {
+        post_event(sh, WAIT_WORK);
+    }
+    return 0;
+}
+
+/**
+ * Parent: TA i died (how says why). Hand back what it held: a lock, the
+ * work_items token it had taken, or the question it was marking or rubric
+ * entry it was checking, which is requeued (or, if it was already done,
+ * counted off its exam for the TA); then count it out of the pool.
+ *
+ * A TA killed within the few instructions between taking a lock or item and
+ * publishing it in its slot can still leave that behind: process-shared
+ * semaphores are not robust, and this only narrows the window.
+ */
+static void reclaim_ta(SharedArea *sh, int i, const char *how) {
+    TaSlot *s = ta_slot(sh, i);
+    s->active.store(0, std::memory_order_relaxed);
+    log_event(sh, -1, EV_TA_DIED, nullptr, i, 0, 0, how);
+
+    int held = s->held_lock.load(std::memory_order_acquire);
+    if (held == HELD_RUBRIC) {
+        if (sh->rubric_seq.load() & 1) {
+            sh->rubric_seq.fetch_add(1, std::memory_order_release); // end its write section
+        }
+        sem_post(&sh->mutex_rubric);
+    } else if (held >= 0) {
+        sem_post(&work_deque(sh, held)->lock);
+    }
+
+    int phase = s->phase.load(std::memory_order_acquire);
+    if (phase == PH_TOKEN) {
+        post_event(sh, WAIT_WORK);
+    } else if (phase == PH_ITEM || phase == PH_COUNTED) {
+        int seq  = s->item_seq.load(std::memory_order_relaxed);
+        int q    = s->item_q.load(std::memory_order_relaxed);
+        int kind = s->item_kind.load(std::memory_order_relaxed);
+        ExamSlot *slot = exam_slot(sh, seq);
+        int *state = (kind == WORK_REVIEW) ? review_states(sh, seq) : question_states(sh, seq);
+        if (state[q] != 2) {
+            state[q] = 0;
+            push_items(sh, -1, deal_target(sh, seq), seq, q, 1, kind);
+            post_event(sh, WAIT_WORK);
+            log_event(sh, -1, EV_REQUEUED, slot->student_id, q + 1, i, kind);
+        } else if (kind == WORK_REVIEW) {
+            // Done but maybe not counted: count it off for the TA
+            if (phase == PH_ITEM) {
+                slot->reviews_left.fetch_sub(1, std::memory_order_acq_rel);
+            }
+            if (slot->reviews_left.load() == 0) {
+                // died between checking the last entry and releasing the exam
+                release_exam(sh, -1, seq);
+            }
+        } else {
+            if (phase == PH_ITEM) {
+                slot->questions_left.fetch_sub(1, std::memory_order_acq_rel);
+                log_event(sh, -1, EV_COUNTED_FOR, slot->student_id, q + 1, i);
+            }
+            if (slot->questions_left.load() == 0 && !slot->exam_done.load()) {
+                // died between marking the last question and saying so
+                slot->done_us = clock_us(sh);
+                slot->exam_done.store(1, std::memory_order_release);
+            }
+        }
     }
+    s->phase.store(PH_IDLE, std::memory_order_relaxed);
+    s->held_lock.store(HELD_NONE, std::memory_order_relaxed);
 
-    std::fclose(f);
-    return 0;
+    TaStats *stats = ta_stats(sh, i);
+    metric_add(stats->end_us, clock_us(sh));
+    metric_set(stats->current_exam, -1);
+    metric_set(stats->state, TA_DEAD);
+    sh->ta_deaths.fetch_add(1, std::memory_order_relaxed);
 }
 
 /**
- * Save rubric from shared memory back to file.
- * Caller must hold mutex_rubric while calling this.
+ * Parent: slot i's TA is gone; dead unless it got to say it was exiting.
  */
-static int save_rubric(const char *rubric_path, SharedArea *sh) {
-    FILE *f = std::fopen(rubric_path, "w");
-    if (!f) {
-        std::perror("fopen rubric for write");
-        return -1;
+static void ta_gone(TaPool *pool, SharedArea *sh, int i, int status) {
+    pool->running[i] = 0;
+    pool->pid[i] = -1;
+    sh->running_TAs.fetch_sub(1, std::memory_order_relaxed);
+    if (ta_stats(sh, i)->state.load(std::memory_order_relaxed) == TA_EXITED) {
+        ta_slot(sh, i)->active.store(0, std::memory_order_relaxed);
+        return;
     }
-
-    for (int i = 0; i < NUM_QUESTIONS; i++) {
-        std::fprintf(f, "%d, %c\n", i + 1, sh->rubric[i]);
+    char how[28];
+    if (WIFSIGNALED(status)) {
+        std::snprintf(how, sizeof(how), "signal %d", WTERMSIG(status));
+    } else {
+        std::snprintf(how, sizeof(how), "exit status %d", WEXITSTATUS(status));
     }
-
-    std::fclose(f);
-    return 0;
+    reclaim_ta(sh, i, how);
 }
 
 /**
- * Helper: log with global G-counter (protected by mutex_log).
+ * Parent, every HEARTBEAT_MS and on every SIGCHLD (real time only):
+ * - reap TAs that exited, reclaiming the work of any that died;
+ * - kill TAs that missed their check-in by TA_HANG_MS (threads cannot be
+ *   killed, so a hung thread is only reported);
+ * - grow the pool by one while the backlog is at least two questions per
+ *   running TA and none of them is idle, shrink it by one when a TA has
+ *   been idle for SHRINK_IDLE_MS with nothing queued, within
+ *   [min_TAs, num_TAs];
+ * - start TAs in free slots until target are running, so a dead TA is
+ *   replaced.
  */
-static void log_parent(SharedArea *sh, const char *fmt, ...) {
-    sem_wait(&sh->mutex_log);
-    int log_id = sh->log_counter++;
+static void supervise(TaPool *pool, SharedArea *sh) {
+    int64_t now = clock_us(sh);
+    int live = 0;       // running and not retiring
+    int waiting = 0;
+    for (int i = 0; i < sh->num_TAs; i++) {
+        if (!pool->running[i]) {
+            continue;
+        }
+        TaStats *stats = ta_stats(sh, i);
+        TaSlot *s = ta_slot(sh, i);
+        if (pool->mode == MODE_THREADS) {
+            if (stats->state.load(std::memory_order_relaxed) == TA_EXITED) {
+                pool->threads[i].join();
+                ta_gone(pool, sh, i, 0);
+                continue;
+            }
+        } else {
+            int status;
+            if (waitpid(pool->pid[i], &status, WNOHANG) == pool->pid[i]) {
+                ta_gone(pool, sh, i, status);
+                continue;
+            }
+        }
+
+        int64_t late_ms = (now - s->deadline_us.load(std::memory_order_relaxed)) / 1000;
+        if (late_ms > TA_HANG_MS && !pool->hung[i]) {
+            bool can_kill = pool->mode == MODE_PROCESS;
+            log_event(sh, -1, EV_TA_HUNG, nullptr, i, static_cast<int>(late_ms), can_kill);
+            if (can_kill) {
+                kill(pool->pid[i], SIGKILL); // reaped (and reclaimed) on SIGCHLD
+            }
+            pool->hung[i] = 1;
+        }
 
-    std::printf("[G%05d][PARENT] ", log_id);
+        if (stats->state.load(std::memory_order_relaxed) == TA_WAITING) {
+            waiting++;
+            if (pool->idle_since[i] == 0) {
+                pool->idle_since[i] = now;
+            }
+        } else {
+            pool->idle_since[i] = 0;
+        }
+        if (!s->retire.load(std::memory_order_relaxed)) {
+            live++;
+        }
+    }
 
-    va_list args;
-    va_start(args, fmt);
-    std::vprintf(fmt, args);
-    va_end(args);
+    int queued = sh->queued.load(std::memory_order_relaxed);
+    bool closed = sh->input_closed.load(std::memory_order_relaxed);
+    if (closed && queued == 0 && sh->reviews_open.load(std::memory_order_relaxed) == 0) {
+        return; // TAs are finishing up, nothing to start
+    }
+    if (!closed && pool->min_TAs < sh->num_TAs) {
+        if (queued >= 2 * live && waiting == 0 && pool->target < sh->num_TAs) {
+            pool->target++;
+        } else if (queued == 0 && live > pool->min_TAs) {
+            for (int i = sh->num_TAs - 1; i >= 0; i--) {
+                TaSlot *s = ta_slot(sh, i);
+                if (pool->running[i] && !s->retire.load(std::memory_order_relaxed) &&
+                    pool->idle_since[i] != 0 &&
+                    now - pool->idle_since[i] >= SHRINK_IDLE_MS * 1000LL) {
+                    s->active.store(0, std::memory_order_relaxed);
+                    s->retire.store(1, std::memory_order_release);
+                    pool->target = live - 1;
+                    live--;
+                    break;
+                }
+            }
+        }
+    }
 
-    std::printf("\n");
-    sem_post(&sh->mutex_log);
+    for (int i = 0; i < sh->num_TAs && live < pool->target; i++) {
+        if (pool->running[i]) {
+            continue;
+        }
+        ta_slot(sh, i)->generation.fetch_add(1, std::memory_order_relaxed);
+        if (spawn_ta(pool, sh, i) == 0) {
+            live++;
+            log_event(sh, -1, EV_TA_STARTED, nullptr, i, queued, live);
+        }
+    }
 }
 
 /**
- * Helper: log for a TA.
+ * Parent, once input is drained: wait for every TA to exit. Forked TAs are
+ * polled so that a helper dying meanwhile is still noticed: a TA waiting
+ * on its ring would otherwise never exit.
  */
-static void log_ta(SharedArea *sh, int ta_id, const char *fmt, ...) {
-    sem_wait(&sh->mutex_log);
-    int log_id = sh->log_counter++;
+static void finish_pool(TaPool *pool, SharedArea *sh) {
+    for (int i = 0; i < sh->num_TAs; i++) {
+        if (!pool->running[i]) {
+            continue;
+        }
+        int status = 0;
+        if (pool->mode == MODE_THREADS) {
+            pool->threads[i].join();
+        } else {
+            pid_t got;
+            while ((got = waitpid(pool->pid[i], &status, WNOHANG)) == 0 ||
+                   (got < 0 && errno == EINTR)) {
+                check_helpers(sh);
+                if (sh->simulate) {
+                    usleep(1000);
+                } else {
+                    wait_event(sh, sh->num_TAs, WAIT_PARENT, HEARTBEAT_MS);
+                }
+            }
+        }
+        ta_gone(pool, sh, i, status);
+    }
+}
 
-    std::printf("[G%05d][TA %d] ", log_id, ta_id);
+/**
+ * Simulation: print simulated throughput and per-TA utilization after the
+ * log. makespan_us is the virtual time at which the last exam was retired.
+ */
+static void print_sim_report(SharedArea *sh, int64_t makespan_us) {
+    int64_t end_us = sh->sim_now_us > 0 ? sh->sim_now_us : 1;
+    int exams = sh->retire_seq;
 
-    va_list args;
-    va_start(args, fmt);
-    std::vprintf(fmt, args);
-    va_end(args);
+    std::printf("Simulation summary:\n");
+    std::printf("  seed               : %llu\n",
+                static_cast<unsigned long long>(sh->seed));
+    std::printf("  exams marked       : %d\n", exams);
+    std::printf("  simulated makespan : %.3f s\n", makespan_us / 1e6);
+    if (makespan_us > 0) {
+        std::printf("  throughput         : %.2f exams/hour\n",
+                    exams * 3600e6 / makespan_us);
+    }
+    for (int i = 0; i < sh->num_TAs; i++) {
+        int64_t busy = metric(ta_stats(sh, i)->busy_us);
+        std::printf("  TA %-3d utilization : %5.1f%% (busy %.3f s of %.3f s)\n",
+                    i, 100.0 * busy / end_us, busy / 1e6, end_us / 1e6);
+    }
+    std::fflush(stdout);
+}
 
-    std::printf("\n");
-    sem_post(&sh->mutex_log);
+/**
+ * Value at percentile p (0..100) of sorted, nearest-rank.
+ */
+static int64_t percentile(const std::vector<int64_t> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(p / 100.0 * sorted.size() + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    return sorted[std::min(rank, sorted.size()) - 1];
 }
 
 /**
- * Load exam #idx (1-based) into shared memory.
- * Files are named exam01.txt, exam02.txt, ... inside exam_dir.
- * First line = 4-digit student number.
- *
- * If student number is 9999, terminate flag is set.
+ * Print how each priority class fared, after the log: exams, the p99 of
+ * their time from being taken from the input to done, and how many
+ * missed their deadline. Times are virtual with --simulate.
  */
-static int load_exam(const char *exam_dir, int idx, SharedArea *sh) {
-    char path[512];
-    std::snprintf(path, sizeof(path), "%s/exam%02d.txt", exam_dir, idx);
+static void print_schedule_report(Scheduler *s) {
+    std::printf("Schedule summary (%s):\n", schedule_name(s->policy));
+    for (auto it = s->classes.rbegin(); it != s->classes.rend(); ++it) {
+        ClassStats &c = it->second;
+        std::sort(c.latencies.begin(), c.latencies.end());
+        std::printf("  priority %d : %zu exams, p99 %.3f s, %d of %d deadlines missed\n",
+                    it->first, c.latencies.size(), percentile(c.latencies, 99) / 1e6,
+                    c.missed, c.deadlines);
+    }
+    std::fflush(stdout);
+}
 
-    FILE *f = std::fopen(path, "r");
+/**
+ * Write one JSON object summarizing the run to path (--stats): throughput,
+ * per-exam latency percentiles, TA busy/idle fractions, lock waits, work
+ * steals, how many TAs were started and died, and per priority class the
+ * p99 latency and deadline misses.
+ * Times are virtual with --simulate.
+ */
+static int write_stats(const char *path, SharedArea *sh, int64_t makespan_us,
+                       std::vector<int64_t> latencies, int io_backend, Scheduler *sched) {
+    FILE *f = std::fopen(path, "w");
     if (!f) {
-        // no more exams or error -> signal terminate
-        std::perror("fopen exam");
-        sh->terminate = 1;
+        std::perror("fopen stats");
         return -1;
     }
+    std::sort(latencies.begin(), latencies.end());
 
-    char line[256];
-    if (!std::fgets(line, sizeof(line), f)) {
-        std::fprintf(stderr, "Empty exam file: %s\n", path);
-        std::fclose(f);
-        sh->terminate = 1;
-        return -1;
+    int64_t life = 0, busy = 0, idle = 0, lock_wait = 0, lock_waits = 0, steals = 0;
+    for (int i = 0; i < sh->num_TAs; i++) {
+        TaStats *t = ta_stats(sh, i);
+        life       += metric(t->end_us) - metric(t->start_us);
+        busy       += metric(t->busy_us);
+        idle       += metric(t->idle_us);
+        lock_wait  += metric(t->lock_wait_us);
+        lock_waits += metric(t->lock_waits);
+        steals     += metric(t->steals);
     }
+    double elapsed_s = makespan_us / 1e6;
+    int exams = sh->retire_seq;
 
-    // Take the first 4 chars as student ID
-    std::memcpy(sh->student_id, line, 4); // Copy first 4 chars from line into student_id
-    sh->student_id[4] = '\0';
-
-    log_parent(sh, "Loaded exam %02d from %s, student %s", idx, path, sh->student_id);
-
-    std::fclose(f);
-
-    // Reset question states
-    for (int i = 0; i < NUM_QUESTIONS; i++) {
-        sh->question_state[i] = 0;
+    std::fprintf(f,
+                 "{\"tas\": %d, \"questions\": %d, \"exams\": %d, "
+                 "\"mode\": \"%s\", \"ring_slots\": %d, \"simulate\": %d, "
+                 "\"delay_scale\": %g, \"io\": \"%s\", "
+                 "\"seed\": %llu, "
+                 "\"elapsed_s\": %.6f, \"exams_per_sec\": %.6f, "
+                 "\"latency_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, "
+                 "\"max\": %.3f}, "
+                 "\"ta_busy_fraction\": %.6f, \"ta_idle_fraction\": %.6f, "
+                 "\"lock_wait_ms\": %.3f, \"lock_waits\": %lld, \"steals\": %lld, "
+                 "\"ta_spawns\": %d, \"ta_deaths\": %d, "
+                 "\"schedule\": \"%s\", \"classes\": [",
+                 sh->num_TAs, sh->num_questions, exams,
+                 sh->mode == MODE_THREADS ? "threads" : "process", sh->ring_slots,
+                 sh->simulate, sh->delay_scale, io_backend_name(io_backend),
+                 static_cast<unsigned long long>(sh->seed),
+                 elapsed_s, elapsed_s > 0 ? exams / elapsed_s : 0.0,
+                 percentile(latencies, 50) / 1e3, percentile(latencies, 90) / 1e3,
+                 percentile(latencies, 99) / 1e3, percentile(latencies, 100) / 1e3,
+                 life > 0 ? static_cast<double>(busy) / life : 0.0,
+                 life > 0 ? static_cast<double>(idle) / life : 0.0,
+                 lock_wait / 1e3, static_cast<long long>(lock_waits),
+                 static_cast<long long>(steals),
+                 sh->ta_spawns.load(std::memory_order_relaxed),
+                 sh->ta_deaths.load(std::memory_order_relaxed),
+                 schedule_name(sched->policy));
+    const char *sep = "";
+    for (auto it = sched->classes.rbegin(); it != sched->classes.rend(); ++it) {
+        ClassStats &c = it->second;
+        std::sort(c.latencies.begin(), c.latencies.end());
+        std::fprintf(f, "%s{\"priority\": %d, \"exams\": %zu, \"p99_ms\": %.3f, "
+                        "\"deadlines\": %d, \"missed\": %d}",
+                     sep, it->first, c.latencies.size(), percentile(c.latencies, 99) / 1e3,
+                     c.deadlines, c.missed);
+        sep = ", ";
     }
-    sh->exam_done = 0;
+    std::fprintf(f, "]}\n");
+    std::fclose(f);
+    return 0;
+}
 
-    // Set terminate if this is the sentinel student
-    if (std::strncmp(sh->student_id, "9999", 4) == 0) {
-        log_parent(sh, "Student 9999 reached. Setting terminate flag.");
-        sh->terminate = 1;
-    }
+// Command line settings
+struct Config {
+    int         num_TAs;            // TAs started
+    int         min_TAs;            // pool bounds for the supervisor
+    int         max_TAs;
+    const char *rubric_path;
+    const char *exam_dir;
+    int         mode;               // RunMode
+    int         rubric_flush_ms;    // write-behind interval for rubric saves
+    int         ring_slots;         // exams loaded ahead of the TAs
+    int         prefetch;           // exams read ahead of the ring
+    int         watch;              // 1 = keep watching exam_dir for new files
+    int         simulate;           // 1 = run on a virtual clock
+    double      delay_scale;        // multiplier on review/marking delays
+    const char *stats_path;         // JSON run summary, or nullptr
+    const char *trace_path;         // Chrome trace-event JSON, or nullptr
+    const char *persist_path;       // checkpoint file, or nullptr
+    const char *results_path;       // CSV of every marked question, or nullptr
+    int         results_commit_ms;  // group-commit window of the results file
+    int         io_backend;         // IoBackend for exam reads and file writes
+    int         io_forced;          // 1 = --io asked for it explicitly
+    uint64_t    seed;               // --seed, or derived from time and pid
+    int         delay_dist;         // DelayDist
+    DelaySpec   review_delay;
+    DelaySpec   mark_delay;
+    int         review_policy;      // ReviewPolicy
+    int         review_every;
+    int         schedule;           // SchedulePolicy
+    const char *manifest_path;      // per-exam priority/deadline, or nullptr
+};
 
-    return 0;
+static void usage(const char *prog) {
+    std::fprintf(stderr,
+                 "Usage: %s [options] <num_TAs> <rubric_file> <exam_dir>\n"
+                 "Options:\n"
+                 "  --mode=M              run TAs as 'process'es (default) or"
+                 " 'threads'\n"
+                 "  --min-tas=N           let the pool shrink to N TAs when idle"
+                 " (default num_TAs)\n"
+                 "  --max-tas=N           let the pool grow to N TAs under backlog"
+                 " (default num_TAs)\n"
+                 "  --rubric-flush-ms=N   save the rubric at most once every N ms"
+                 " (default 250)\n"
+                 "  --ring-slots=N        keep up to N exams loaded ahead"
+                 " (default %d)\n"
+                 "  --prefetch=K          read up to K exams ahead on a"
+                 " background thread (default %d)\n"
+                 "  --watch               keep watching exam_dir for new exam"
+                 " files until\n"
+                 "                        the 9999 sentinel arrives\n"
+                 "  --simulate            replace real sleeps with a virtual clock"
+                 " and report\n"
+                 "                        simulated throughput and utilization\n"
+                 "  --delay-scale=F       multiply review and marking delays by F"
+                 " (default 1)\n"
+                 "  --stats=FILE          write a JSON run summary (throughput,"
+                 " latency,\n"
+                 "                        idle fraction, lock waits) to FILE\n"
+                 "  --trace=FILE          write a Chrome/Perfetto trace of every"
+                 " TA to FILE\n"
+                 "  --persist=FILE        checkpoint progress in FILE and resume"
+                 " from it after\n"
+                 "                        a crash (removed once the run completes)\n"
+                 "  --results=FILE        record every marked question (student,"
+                 " question,\n"
+                 "                        letter, TA, time) as CSV in FILE\n"
+                 "  --results-commit-ms=N write and fsync the results at most"
+                 " once every N ms\n"
+                 "                        (default 100)\n"
+                 "  --io=B                file I/O backend: auto (io_uring if"
+                 " available, else\n"
+                 "                        threads), uring or threads\n"
+                 "  --seed=N              seed the per-TA random streams"
+                 " (default: time/pid)\n"
+                 "  --review-ms=MIN-MAX   rubric check delay (default 500-1000)\n"
+                 "  --mark-ms=MIN-MAX     marking delay (default 1000-2000)\n"
+                 "  --delay-dist=D        uniform, exponential or fixed"
+                 " (default uniform)\n"
+                 "  --review=P            rubric review before each exam: full"
+                 " (default),\n"
+                 "                        changed (entries changed since the TA's"
+                 " last look)\n"
+                 "                        every:N (full review every N exams)\n"
+                 "                        or partitioned (each entry once per exam,"
+                 " by any TA)\n"
+                 "  --schedule=S          order exams are loaded in: fifo (default),"
+                 " priority\n"
+                 "                        or edf (earliest deadline first)\n"
+                 "  --manifest=FILE       per-exam 'student, priority[, deadline s]'"
+                 " lines,\n"
+                 "                        overriding the exam headers\n",
+                 prog, DEFAULT_RING_SLOTS, DEFAULT_PREFETCH);
 }
 
 /**
- * Code executed by each TA process.
- * - Works only with data in shared memory (no direct file I/O).
- * - Reviews rubric, possibly changes entries, and sets rubric_dirty.
- * - Marks questions for current exam, prints actions.
- * - Uses semaphores (no busy waiting) when waiting for next exams.
+ * Parse options and the three positional arguments into cfg.
+ * Returns 0 on success, -1 (after printing a message) otherwise.
  */
-static void ta_process(int ta_id, SharedArea *sh) {
+static int parse_args(int argc, char *argv[], Config *cfg) {
+    enum { OPT_RUBRIC_FLUSH_MS = 256, OPT_RING_SLOTS, OPT_SIMULATE,
+           OPT_DELAY_SCALE, OPT_STATS, OPT_SEED, OPT_REVIEW_MS, OPT_MARK_MS,
+           OPT_DELAY_DIST, OPT_MODE, OPT_PREFETCH, OPT_WATCH, OPT_TRACE,
+           OPT_MIN_TAS, OPT_MAX_TAS, OPT_PERSIST, OPT_REVIEW, OPT_RESULTS,
+           OPT_RESULTS_COMMIT_MS, OPT_IO, OPT_SCHEDULE, OPT_MANIFEST };
+    static const struct option long_opts[] = {
+        {"rubric-flush-ms", required_argument, nullptr, OPT_RUBRIC_FLUSH_MS},
+        {"ring-slots",      required_argument, nullptr, OPT_RING_SLOTS},
+        {"simulate",        no_argument,       nullptr, OPT_SIMULATE},
+        {"delay-scale",     required_argument, nullptr, OPT_DELAY_SCALE},
+        {"stats",           required_argument, nullptr, OPT_STATS},
+        {"seed",            required_argument, nullptr, OPT_SEED},
+        {"review-ms",       required_argument, nullptr, OPT_REVIEW_MS},
+        {"mark-ms",         required_argument, nullptr, OPT_MARK_MS},
+        {"delay-dist",      required_argument, nullptr, OPT_DELAY_DIST},
+        {"mode",            required_argument, nullptr, OPT_MODE},
+        {"prefetch",        required_argument, nullptr, OPT_PREFETCH},
+        {"watch",           no_argument,       nullptr, OPT_WATCH},
+        {"trace",           required_argument, nullptr, OPT_TRACE},
+        {"min-tas",         required_argument, nullptr, OPT_MIN_TAS},
+        {"max-tas",         required_argument, nullptr, OPT_MAX_TAS},
+        {"persist",         required_argument, nullptr, OPT_PERSIST},
+        {"review",          required_argument, nullptr, OPT_REVIEW},
+        {"results",         required_argument, nullptr, OPT_RESULTS},
+        {"results-commit-ms", required_argument, nullptr, OPT_RESULTS_COMMIT_MS},
+        {"io",              required_argument, nullptr, OPT_IO},
+        {"schedule",        required_argument, nullptr, OPT_SCHEDULE},
+        {"manifest",        required_argument, nullptr, OPT_MANIFEST},
+        {nullptr, 0, nullptr, 0},
+    };
 
-    // Unique-ish seed per TA
-    std::srand(static_cast<unsigned int>(std::time(nullptr) ^ (getpid() << 16)));
+    cfg->mode            = MODE_PROCESS;
+    cfg->min_TAs         = 0;   // 0 = num_TAs
+    cfg->max_TAs         = 0;
+    cfg->rubric_flush_ms = 250;
+    cfg->ring_slots      = DEFAULT_RING_SLOTS;
+    cfg->prefetch        = DEFAULT_PREFETCH;
+    cfg->watch           = 0;
+    cfg->simulate        = 0;
+    cfg->delay_scale     = 1.0;
+    cfg->stats_path      = nullptr;
+    cfg->trace_path      = nullptr;
+    cfg->persist_path    = nullptr;
+    cfg->results_path    = nullptr;
+    cfg->results_commit_ms = 100;
+    cfg->io_backend      = IO_URING;
+    cfg->io_forced       = 0;
+    cfg->seed            = static_cast<uint64_t>(std::time(nullptr)) ^
+                           (static_cast<uint64_t>(getpid()) << 32);
+    cfg->delay_dist      = DIST_UNIFORM;
+    cfg->review_delay    = {500, 1000};
+    cfg->mark_delay      = {1000, 2000};
+    cfg->review_policy   = REVIEW_FULL;
+    cfg->review_every    = 1;
+    cfg->schedule        = ORDER_FIFO;
+    cfg->manifest_path   = nullptr;
 
-    while (true) {
-        if (sh->terminate) {
-            log_ta(sh, ta_id, "terminate flag set before work, exiting.");
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_opts, nullptr)) != -1) {
+        switch (opt) {
+        case OPT_RUBRIC_FLUSH_MS:
+            cfg->rubric_flush_ms = std::atoi(optarg);
+            if (cfg->rubric_flush_ms < 0) {
+                std::fprintf(stderr, "--rubric-flush-ms must be >= 0\n");
+                return -1;
+            }
+            break;
+        case OPT_RING_SLOTS:
+            cfg->ring_slots = std::atoi(optarg);
+            if (cfg->ring_slots < 1) {
+                std::fprintf(stderr, "--ring-slots must be >= 1\n");
+                return -1;
+            }
+            break;
+        case OPT_PREFETCH:
+            cfg->prefetch = std::atoi(optarg);
+            if (cfg->prefetch < 1) {
+                std::fprintf(stderr, "--prefetch must be >= 1\n");
+                return -1;
+            }
+            break;
+        case OPT_WATCH:
+            cfg->watch = 1;
+            break;
+        case OPT_SIMULATE:
+            cfg->simulate = 1;
+            break;
+        case OPT_DELAY_SCALE:
+            cfg->delay_scale = std::atof(optarg);
+            if (cfg->delay_scale < 0) {
+                std::fprintf(stderr, "--delay-scale must be >= 0\n");
+                return -1;
+            }
+            break;
+        case OPT_STATS:
+            cfg->stats_path = optarg;
+            break;
+        case OPT_TRACE:
+            cfg->trace_path = optarg;
+            break;
+        case OPT_PERSIST:
+            cfg->persist_path = optarg;
+            break;
+        case OPT_RESULTS:
+            cfg->results_path = optarg;
+            break;
+        case OPT_RESULTS_COMMIT_MS:
+            cfg->results_commit_ms = std::atoi(optarg);
+            if (cfg->results_commit_ms < 0) {
+                std::fprintf(stderr, "--results-commit-ms must be >= 0\n");
+                return -1;
+            }
+            break;
+        case OPT_MIN_TAS:
+            cfg->min_TAs = std::atoi(optarg);
+            if (cfg->min_TAs < 1) {
+                std::fprintf(stderr, "--min-tas must be >= 1\n");
+                return -1;
+            }
+            break;
+        case OPT_MAX_TAS:
+            cfg->max_TAs = std::atoi(optarg);
+            if (cfg->max_TAs < 1) {
+                std::fprintf(stderr, "--max-tas must be >= 1\n");
+                return -1;
+            }
+            break;
+        case OPT_SEED:
+            cfg->seed = std::strtoull(optarg, nullptr, 0);
+            break;
+        case OPT_REVIEW_MS:
+        case OPT_MARK_MS: {
+            DelaySpec *spec = (opt == OPT_REVIEW_MS) ? &cfg->review_delay
+                                                     : &cfg->mark_delay;
+            if (std::sscanf(optarg, "%d-%d", &spec->min_ms, &spec->max_ms) != 2 ||
+                spec->min_ms < 0 || spec->max_ms < spec->min_ms) {
+                std::fprintf(stderr, "Bad delay range '%s', expected MIN-MAX\n", optarg);
+                return -1;
+            }
             break;
         }
-
-        log_ta(sh, ta_id, "Starting work on student %s", sh->student_id);
-
-        // 1) Review rubric (IN SHARED MEMORY ONLY, protected by mutex_rubric)
-        for (int q = 0; q < NUM_QUESTIONS; q++) {
-            // Read current rubric letter under lock
-            sem_wait(&sh->mutex_rubric);
-            char current = sh->rubric[q];
-            sem_post(&sh->mutex_rubric);
-
-            log_ta(sh, ta_id, "Checking rubric for Q%d (current '%c')", q + 1, current);
-
-            // 0.5–1.0 seconds regardless of change or not
-            sleep_random_ms(500, 1000);
-
-            // Randomly decide whether to change this rubric entry
-            int change = std::rand() % 2;  // 0 or 1
-            if (change) {
-                sem_wait(&sh->mutex_rubric);
-                char old = sh->rubric[q];
-                char newc = old + 1;
-                if (newc > 'Z') {
-                    newc = 'A';  // wrap around to keep it printable
-                }
-                sh->rubric[q] = newc;
-                sh->rubric_dirty = 1; // tell parent to save
-                sem_post(&sh->mutex_rubric);
-
-                log_ta(sh, ta_id,
-                       "Correcting rubric Q%d: %c -> %c (in shared memory)",
-                       q + 1, old, newc);
+        case OPT_DELAY_DIST:
+            if (std::strcmp(optarg, "uniform") == 0) {
+                cfg->delay_dist = DIST_UNIFORM;
+            } else if (std::strcmp(optarg, "exponential") == 0) {
+                cfg->delay_dist = DIST_EXPONENTIAL;
+            } else if (std::strcmp(optarg, "fixed") == 0) {
+                cfg->delay_dist = DIST_FIXED;
             } else {
-                sem_wait(&sh->mutex_rubric);
-                char still = sh->rubric[q];
-                sem_post(&sh->mutex_rubric);
-
-                log_ta(sh, ta_id,
-                       "Rubric for Q%d unchanged (still '%c')",
-                       q + 1, still);
+                std::fprintf(stderr, "Unknown --delay-dist '%s'\n", optarg);
+                return -1;
             }
-        }
-
-        if (sh->terminate) {
-            log_ta(sh, ta_id, "terminate flag set after rubric, exiting.");
             break;
-        }
-
-        // 2) Mark questions for this exam
-        while (true) {
-            if (sh->terminate) {
-                log_ta(sh, ta_id, "terminate flag set while marking, exiting.");
-                return;
+        case OPT_REVIEW:
+            if (std::strcmp(optarg, "full") == 0) {
+                cfg->review_policy = REVIEW_FULL;
+            } else if (std::strcmp(optarg, "changed") == 0) {
+                cfg->review_policy = REVIEW_CHANGED;
+            } else if (std::strcmp(optarg, "partitioned") == 0) {
+                cfg->review_policy = REVIEW_PARTITIONED;
+            } else if (std::sscanf(optarg, "every:%d", &cfg->review_every) == 1 &&
+                       cfg->review_every >= 1) {
+                cfg->review_policy = REVIEW_EVERY;
+            } else {
+                std::fprintf(stderr, "Unknown --review '%s', expected full, changed,"
+                                     " every:N or partitioned\n", optarg);
+                return -1;
             }
-
-            int q_to_mark = -1;
-            bool all_done = true;
-
-            // Critical section on question_state + exam_done
-            sem_wait(&sh->mutex_questions);
-            for (int i = 0; i < NUM_QUESTIONS; i++) {
-                if (sh->question_state[i] == 0) {
-                    // claim this question
-                    q_to_mark = i;
-                    sh->question_state[i] = 1; // marking in progress
-                    all_done = false;
-                    break;
-                }
-                if (sh->question_state[i] != 2) {
-                    all_done = false;
-                }
+            break;
+        case OPT_MODE:
+            if (std::strcmp(optarg, "process") == 0) {
+                cfg->mode = MODE_PROCESS;
+            } else if (std::strcmp(optarg, "threads") == 0) {
+                cfg->mode = MODE_THREADS;
+            } else {
+                std::fprintf(stderr, "Unknown --mode '%s'\n", optarg);
+                return -1;
             }
-
-            if (q_to_mark == -1 && all_done) {
-                sh->exam_done = 1;
+            break;
+        case OPT_SCHEDULE:
+            if (std::strcmp(optarg, "fifo") == 0) {
+                cfg->schedule = ORDER_FIFO;
+            } else if (std::strcmp(optarg, "priority") == 0) {
+                cfg->schedule = ORDER_PRIORITY;
+            } else if (std::strcmp(optarg, "edf") == 0) {
+                cfg->schedule = ORDER_EDF;
+            } else {
+                std::fprintf(stderr, "Unknown --schedule '%s'\n", optarg);
+                return -1;
             }
-            sem_post(&sh->mutex_questions);
-
-            if (q_to_mark == -1) {
-                if (all_done) {
-                    log_ta(sh, ta_id,
-                           "All questions for student %s appear done.",
-                           sh->student_id);
-                    break;
-                } else {
-                    // someone else is still marking, check again later
-                    usleep(100 * 1000); // 100 ms
-                    continue;
-                }
+            break;
+        case OPT_MANIFEST:
+            cfg->manifest_path = optarg;
+            break;
+        case OPT_IO:
+            if (std::strcmp(optarg, "auto") == 0) {
+                cfg->io_backend = IO_URING;
+                cfg->io_forced  = 0;
+            } else if (std::strcmp(optarg, "uring") == 0) {
+                cfg->io_backend = IO_URING;
+                cfg->io_forced  = 1;
+            } else if (std::strcmp(optarg, "threads") == 0) {
+                cfg->io_backend = IO_THREADS;
+                cfg->io_forced  = 1;
+            } else {
+                std::fprintf(stderr, "Unknown --io '%s'\n", optarg);
+                return -1;
             }
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if (argc - optind != 3) {
+        usage(argv[0]);
+        return -1;
+    }
+    if (cfg->watch && cfg->simulate) {
+        std::fprintf(stderr, "--watch needs real time, not --simulate\n");
+        return -1;
+    }
 
-            // We claimed question q_to_mark; mark it using current rubric
-            sem_wait(&sh->mutex_rubric);
-            char mark_letter = sh->rubric[q_to_mark];
-            sem_post(&sh->mutex_rubric);
+    cfg->num_TAs = std::atoi(argv[optind]);
+    if (cfg->num_TAs < 2) {
+        std::fprintf(stderr, "num_TAs must be >= 2\n");
+        return -1;
+    }
+    cfg->min_TAs = cfg->min_TAs ? cfg->min_TAs : cfg->num_TAs;
+    cfg->max_TAs = cfg->max_TAs ? cfg->max_TAs : cfg->num_TAs;
+    if (cfg->min_TAs > cfg->num_TAs || cfg->max_TAs < cfg->num_TAs) {
+        std::fprintf(stderr, "Need --min-tas <= num_TAs <= --max-tas\n");
+        return -1;
+    }
+    if (cfg->simulate && (cfg->min_TAs != cfg->num_TAs || cfg->max_TAs != cfg->num_TAs)) {
+        std::fprintf(stderr, "--min-tas/--max-tas need real time, not --simulate\n");
+        return -1;
+    }
+    cfg->rubric_path = argv[optind + 1];
+    cfg->exam_dir    = argv[optind + 2];
+    return 0;
+}
 
-            log_ta(sh, ta_id,
-                   "Marking Q%d for student %s (rubric '%c')",
-                   q_to_mark + 1, sh->student_id, mark_letter);
+/**
+ * Allocate the shared area, zeroed: a private SysV segment, which forked
+ * TAs attach to and marker-stat can attach to read-only. Returns nullptr
+ * (after printing why) on failure.
+ */
+static SharedArea *create_area(size_t size, int *shmid) {
+    *shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (*shmid < 0) {
+        std::perror("shmget");
+        return nullptr;
+    }
+    void *mem = shmat(*shmid, nullptr, 0);
+    if (mem == reinterpret_cast<void *>(-1)) {
+        std::perror("shmat");
+        shmctl(*shmid, IPC_RMID, nullptr);
+        return nullptr;
+    }
+    std::memset(mem, 0, size);
+    return static_cast<SharedArea *>(mem);
+}
 
-            // Marking time: 1.0–2.0 seconds
-            sleep_random_ms(1000, 2000);
+/**
+ * Undo create_area().
+ */
+static void release_area(SharedArea *sh, int shmid) {
+    shmdt(sh);
+    shmctl(shmid, IPC_RMID, nullptr);
+}
 
-            // Now set the question as done
-            sem_wait(&sh->mutex_questions);
-            sh->question_state[q_to_mark] = 2;
-            sem_post(&sh->mutex_questions);
+// A helper the parent runs alongside the TAs (the log drainer, the results
+// writer): a thread in threads mode, a forked process otherwise
+struct Helper {
+    pid_t pid = -1;
+    std::thread thread;
+};
 
-            log_ta(sh, ta_id,
-                   "Finished Q%d for student %s",
-                   q_to_mark + 1, sh->student_id);
+/**
+ * Parent: start fn() as helper h (what names it in errors).
+ * Returns 0 on success, -1 (after printing why) otherwise.
+ */
+template <typename Fn>
+static int start_helper(Helper *h, SharedArea *sh, const char *what, Fn fn) {
+    if (sh->mode == MODE_THREADS) {
+        try {
+            h->thread = std::thread(fn);
+        } catch (const std::system_error &e) {
+            std::fprintf(stderr, "%s thread: %s\n", what, e.what());
+            return -1;
         }
+        return 0;
+    }
+    h->pid = fork();
+    if (h->pid < 0) {
+        std::fprintf(stderr, "fork %s: %s\n", what, std::strerror(errno));
+        return -1;
+    } else if (h->pid == 0) {
+        die_with_parent(sh->parent_pid);
+        fn();
+        std::exit(EXIT_SUCCESS);
+    }
+    return 0;
+}
 
-        // 3) Wait for next exam to be loaded (no busy-wait)
-        log_ta(sh, ta_id, "Waiting for next exam...");
+/**
+ * Parent: wait for a helper started by start_helper() to finish.
+ */
+static void join_helper(Helper *h) {
+    if (h->thread.joinable()) {
+        h->thread.join();
+    } else if (h->pid > 0) {
+        waitpid(h->pid, nullptr, 0);
+    }
+}
 
-        // Block here until parent signals a new exam, or terminate is set
-        sem_wait(&sh->exam_ready);
-        if (sh->terminate) {
-            log_ta(sh, ta_id, "woken up but terminate flag set, exiting.");
-            break;
+/**
+ * Parent, at the end of the run: join both helpers. Returns the HelperBits
+ * of those that died at any point, whose records were dropped.
+ */
+static int join_helpers(Helper *drainer, Helper *results_writer, SharedArea *sh) {
+    Helper *h[2] = {drainer, results_writer};
+    for (int i = 0; i < 2; i++) {
+        if (h[i]->thread.joinable()) {
+            h[i]->thread.join();
+            continue;
+        }
+        int status;
+        if (g_helper_pid[i] <= 0 || waitpid(g_helper_pid[i], &status, 0) != g_helper_pid[i]) {
+            continue; // not started, or already reaped by check_helpers()
+        }
+        g_helper_pid[i] = -1;
+        if (!helper_exited(i, status)) {
+            sh->helper_lost.fetch_or(1 << i, std::memory_order_release);
         }
-        // Otherwise, loop continues and TA will see new student_id, etc.
     }
+    return sh->helper_lost.load(std::memory_order_acquire);
 }
 
-
 int main(int argc, char *argv[]) {
-    if (argc != 4) {
-        std::fprintf(stderr,
-                     "Usage: %s <num_TAs> <rubric_file> <exam_dir>\n", argv[0]);
+    Config cfg;
+    if (parse_args(argc, argv, &cfg) != 0) {
         return EXIT_FAILURE;
     }
 
-    int num_TAs = std::atoi(argv[1]);
-    if (num_TAs < 2) {
-        std::fprintf(stderr, "num_TAs must be >= 2\n");
+    int num_TAs = cfg.max_TAs;  // TA slots; cfg.num_TAs of them start running
+    const char *rubric_path = cfg.rubric_path;
+    const char *exam_dir    = cfg.exam_dir;
+
+    // The rubric file decides the question count, and with it the layout
+    std::vector<char> rubric;
+    if (read_rubric(rubric_path, &rubric) != 0) {
+        std::fprintf(stderr, "Failed to load rubric\n");
+        return EXIT_FAILURE;
+    }
+    std::unordered_map<std::string, ExamMeta> manifest;
+    if (cfg.manifest_path && read_manifest(cfg.manifest_path, &manifest) != 0) {
         return EXIT_FAILURE;
     }
 
-    const char *rubric_path = argv[2];
-    const char *exam_dir    = argv[3];
+    // --persist: pick up where a previous run stopped (this may replace the
+    // rubric with the checkpoint's newer copy)
+    Persist persist;
+    Persist *ps = nullptr;
+    if (cfg.persist_path) {
+        persist.path = cfg.persist_path;
+        if (open_checkpoint(&persist, exam_dir, cfg.ring_slots, &rubric) != 0) {
+            return EXIT_FAILURE;
+        }
+        ps = &persist;
+    }
 
-    // Create shared memory segment
-    int shmid = shmget(IPC_PRIVATE, sizeof(SharedArea),
-                       IPC_CREAT | 0600);
-    if (shmid < 0) {
-        std::perror("shmget");
-        return EXIT_FAILURE;
+    // --results: a resumed run adds to the rows of the one it carries on
+    int results_fd = -1;
+    int64_t results_size = 0;
+    if (cfg.results_path) {
+        bool resume = ps && (ps->retired > 0 || !ps->in_flight.empty());
+        results_fd = open_results(cfg.results_path, resume, ps ? ps->results_size : 0,
+                                  &results_size);
+        if (results_fd < 0) {
+            return EXIT_FAILURE;
+        }
+        if (g_ckpt) {
+            g_ckpt->results_size.store(results_size, std::memory_order_release);
+        }
     }
 
-    SharedArea *sh = static_cast<SharedArea *>(shmat(shmid, nullptr, 0));
-    if (sh == reinterpret_cast<void *>(-1)) {
-        std::perror("shmat");
-        shmctl(shmid, IPC_RMID, nullptr);
+    int num_questions = static_cast<int>(rubric.size());
+    ShmLayout layout = compute_layout(num_questions, cfg.ring_slots, num_TAs);
+
+    // Shared area sized to match
+    int shmid;
+    SharedArea *sh = create_area(layout.total, &shmid);
+    if (!sh) {
         return EXIT_FAILURE;
     }
+    if (ps) {
+        remove_stale_area(ps->old_shmid);
+        g_ckpt->shmid = shmid;
+    }
 
     // Initialize shared memory
-    std::memset(sh, 0, sizeof(*sh));
-    sh->terminate    = 0;
-    sh->exam_done    = 0;
-    sh->rubric_dirty = 0;
-    sh->log_counter  = 0;
-
-    // Initialize semaphores (pshared = 1 -> shared between processes)
-    if (sem_init(&sh->mutex_rubric,    1, 1) == -1 ||
-        sem_init(&sh->mutex_questions, 1, 1) == -1 ||
-        sem_init(&sh->mutex_log,       1, 1) == -1 ||
-        sem_init(&sh->exam_ready,      1, 0) == -1) {
+    sh->magic         = SHARED_AREA_MAGIC;
+    sh->version       = SHARED_AREA_VERSION;
+    sh->parent_pid    = getpid();
+    sh->started_us    = now_us();
+    sh->num_questions = num_questions;
+    sh->ring_slots    = cfg.ring_slots;
+    sh->num_TAs       = num_TAs;
+    sh->min_TAs       = cfg.min_TAs;
+    sh->layout        = layout;
+    sh->mode          = cfg.mode;
+    sh->simulate      = cfg.simulate;
+    sh->delay_scale   = cfg.delay_scale;
+    sh->delay_dist    = cfg.delay_dist;
+    sh->review_delay  = cfg.review_delay;
+    sh->mark_delay    = cfg.mark_delay;
+    sh->review_policy = cfg.review_policy;
+    sh->review_every  = cfg.review_every;
+    sh->results       = (results_fd >= 0);
+    sh->seed          = cfg.seed;
+    sh->sim_now_us    = 0;
+    sh->input_closed  = 0;
+    sh->queued        = 0;
+    sh->reviews_open  = 0;
+    sh->stops_held    = 0;
+    sh->rubric_dirty  = 0;
+    sh->log_counter   = 0;
+    sh->log_closed    = 0;
+    sh->helper_lost   = 0;
+    sh->running_TAs   = 0;
+    sh->ta_spawns     = 0;
+    sh->ta_deaths     = 0;
+
+    // A resumed run carries on from the checkpoint: exam numbers, rubric
+    // version, and a save of the rubric if the file missed corrections
+    if (ps) {
+        sh->load_seq       = static_cast<int>(ps->retired);
+        sh->retire_seq     = sh->load_seq;
+        sh->rubric_version = ps->rubric_version;
+        sh->rubric_dirty   = ps->rubric_changed;
+    }
+
+    // Initialize semaphores (pshared = 1 -> shared between processes;
+    // threads get the cheaper process-private kind)
+    int pshared = (cfg.mode == MODE_PROCESS);
+    if (sem_init(&sh->mutex_rubric,    pshared, 1) == -1 ||
+        sem_init(&sh->work_items,      pshared, 0) == -1 ||
+        sem_init(&sh->parent_wake,     pshared, 0) == -1) {
         std::perror("sem_init");
-        shmdt(sh);
-        shmctl(shmid, IPC_RMID, nullptr);
+        release_area(sh, shmid);
         return EXIT_FAILURE;
     }
+    for (int i = 0; i <= num_TAs; i++) {
+        SimActor *a = sim_actor(sh, i);
+        a->state   = SIM_RUNNABLE; // everyone starts at virtual time 0
+        a->wake_at = 0;
+        if (sem_init(&a->turn, pshared, 0) == -1) {
+            std::perror("sem_init");
+            release_area(sh, shmid);
+            return EXIT_FAILURE;
+        }
+    }
+    for (int i = 0; i < num_TAs; i++) {
+        if (sem_init(&work_deque(sh, i)->lock, pshared, 1) == -1) {
+            std::perror("sem_init");
+            release_area(sh, shmid);
+            return EXIT_FAILURE;
+        }
+    }
 
     // Load rubric into shared memory
-    if (load_rubric(rubric_path, sh) != 0) {
-        std::fprintf(stderr, "Failed to load rubric\n");
-        shmdt(sh);
-        shmctl(shmid, IPC_RMID, nullptr);
-        return EXIT_FAILURE;
+    for (int q = 0; q < num_questions; q++) {
+        rubric_at(sh, q).store(rubric[q], std::memory_order_relaxed);
     }
 
-    // Load first exam
-    int exam_index = 1;
-    if (load_exam(exam_dir, exam_index, sh) != 0) {
-        std::fprintf(stderr, "Failed to load first exam\n");
-        shmdt(sh);
-        shmctl(shmid, IPC_RMID, nullptr);
+    // The first cfg.num_TAs slots are in the pool (exams are dealt to them
+    // from the first load on), the rest wait for the supervisor
+    for (int i = 0; i < num_TAs; i++) {
+        ta_slot(sh, i)->held_lock = HELD_NONE;
+        ta_slot(sh, i)->active    = (i < cfg.num_TAs);
+        metric_set(ta_stats(sh, i)->state, TA_OFF);
+    }
+
+    // File I/O of the parent, the exam reader and the results writer goes
+    // through AsyncIo; --simulate keeps it synchronous so runs stay
+    // deterministic
+    int io_backend = cfg.simulate ? IO_SYNC : cfg.io_backend;
+
+    // Start the log drainer first: from here on nobody prints log lines
+    // directly, every record goes through the rings
+    std::fflush(stdout);
+    Helper drainer;
+    if (start_helper(&drainer, sh, "drainer", [sh, exam_dir] { drain_logs(sh, exam_dir); })
+        != 0) {
+        release_area(sh, shmid);
         return EXIT_FAILURE;
     }
+    g_helper_pid[0] = drainer.pid;
 
-    // Fork TA processes
-    for (int i = 0; i < num_TAs; i++) {
-        pid_t pid = fork();
-        if (pid < 0) {
-            std::perror("fork");
-        } else if (pid == 0) {
-            // Child TA process
-            SharedArea *child_sh =
-                static_cast<SharedArea *>(shmat(shmid, nullptr, 0));
-            if (child_sh == reinterpret_cast<void *>(-1)) {
-                std::perror("shmat in child");
-                std::exit(EXIT_FAILURE);
-            }
-            ta_process(i, child_sh);
-            shmdt(child_sh);
-            std::exit(EXIT_SUCCESS);
+    // Then the results writer, the only one touching the results file. Its
+    // timestamps are Unix time: a record's clock plus the offset taken here.
+    Helper results_writer;
+    if (results_fd >= 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ResultsWriter rw = {results_fd, cfg.results_commit_ms,
+                            static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000 -
+                            clock_us(sh), io_backend, results_size};
+        int started = start_helper(&results_writer, sh, "results writer",
+                                   [sh, rw] { write_results(sh, rw); });
+        if (cfg.mode == MODE_PROCESS) {
+            close(results_fd); // the writer has its own copy
+        }
+        if (started != 0) {
+            sh->log_closed = 1;
+            join_helper(&drainer);
+            release_area(sh, shmid);
+            return EXIT_FAILURE;
         }
-        // Parent continues loop
+        g_helper_pid[1] = results_writer.pid;
+    }
+
+    // List the exam directory and load the first exams into the ring
+    // (inline: the reader thread only starts once the TAs are running)
+    ExamSource exams;
+    int rc = open_exam_source(&exams, exam_dir, sh, cfg.prefetch, cfg.watch);
+    size_t num_exams = exams.batch ? exams.batch_count : exams.names.size();
+    if (rc == 0 && num_exams == 0 && exams.watch_fd < 0) {
+        std::fprintf(stderr, "No exam files in %s\n", exam_dir);
+        rc = -1;
+    }
+    if (rc == 0 && ps && seek_exam_source(&exams, ps) != 0) {
+        rc = -1;
+    }
+    if (rc == 0 && cfg.trace_path && trace_open(cfg.trace_path, num_TAs) != 0) {
+        rc = -1;
+    }
+    if (rc != 0) {
+        close_exam_source(&exams);
+        sh->log_closed = 1;
+        join_helper(&drainer);
+        join_helper(&results_writer);
+        release_area(sh, shmid);
+        return EXIT_FAILURE;
     }
+    if (ps && (ps->retired > 0 || !ps->in_flight.empty())) {
+        log_event(sh, -1, EV_RESUMED, nullptr, static_cast<int>(ps->retired),
+                  static_cast<int>(ps->rubric_version));
+    }
+    Scheduler sched;
+    init_scheduler(&sched, sh, cfg.schedule, cfg.prefetch,
+                   cfg.manifest_path ? &manifest : nullptr, ps);
+    fill_ring(&exams, sh, ps, &sched);
 
-    // Parent loop: coordinate exams and file I/O
-    std::srand(static_cast<unsigned int>(std::time(nullptr)));
+    // Throughput is measured from here so that it includes starting the TAs
+    int64_t start_us = clock_us(sh);
 
-    while (!sh->terminate) {
-        // If current exam is done (as seen by some TA), load the next one
-        bool exam_done_copy = false;
+    // Start TA processes (or threads running the same ta_process). In real
+    // time a SIGCHLD wakes the parent so a dead TA is reaped and replaced
+    // at once.
+    TaPool pool;
+    pool.mode    = cfg.mode;
+    pool.shmid   = shmid;
+    pool.min_TAs = cfg.min_TAs;
+    pool.target  = cfg.num_TAs;
+    pool.pid.assign(num_TAs, -1);
+    pool.threads.resize(num_TAs);
+    pool.running.assign(num_TAs, 0);
+    pool.hung.assign(num_TAs, 0);
+    pool.idle_since.assign(num_TAs, 0);
+    if (cfg.mode == MODE_PROCESS && !sh->simulate) {
+        g_parent_sh = sh;
+        struct sigaction sa;
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_sigchld;
+        sa.sa_flags   = SA_RESTART | SA_NOCLDSTOP;
+        sigaction(SIGCHLD, &sa, nullptr);
+    }
+    for (int i = 0; i < cfg.num_TAs; i++) {
+        spawn_ta(&pool, sh, i);
+    }
 
-        sem_wait(&sh->mutex_questions);
-        exam_done_copy = (sh->exam_done != 0);
-        sem_post(&sh->mutex_questions);
+    // From here on exam files are read ahead on their own thread (started
+    // after the first forks; a TA started later by the supervisor does not
+    // use it). --simulate keeps reading inline so the virtual schedule does
+    // not depend on it, and a mapped batch needs no reader at all.
+    if (!sh->simulate && !exams.batch) {
+        start_exam_reader(&exams, io_backend);
+    }
 
-        if (exam_done_copy && !sh->terminate) {
-            exam_index++;
-            if (load_exam(exam_dir, exam_index, sh) != 0) {
-                // load_exam sets terminate in error/sentinel cases
-                break;
-            }
+    // Parent loop: coordinate exams and file I/O. Rubric saves are issued
+    // through parent_io, whose completions wake the parent like a TA does.
+    AsyncIo parent_io;
+    int why;
+    io_backend = async_io_open(&parent_io, io_backend, 1, wake_parent, sh, &why);
+    if (why && cfg.io_forced) {
+        std::fprintf(stderr, "io_uring unavailable (%s), using %s\n", std::strerror(why),
+                     io_backend_name(io_backend));
+    }
 
-            // Reset exam_done under protection
-            sem_wait(&sh->mutex_questions);
-            sh->exam_done = 0;
-            sem_post(&sh->mutex_questions);
+    RubricWriter rubric_writer;
+    rubric_writer.path         = rubric_path;
+    rubric_writer.interval_ms  = cfg.rubric_flush_ms;
+    rubric_writer.last_save_ms = 0;
+    rubric_writer.durable      = !sh->simulate;
+    rubric_writer.io           = &parent_io;
+    rubric_writer.step         = SAVE_IDLE;
+    int64_t makespan_us = 0;
+    std::vector<int64_t> latencies;     // per-exam load-to-done, for --stats
 
-            // Wake each TA once so they can start on this exam
-            for (int i = 0; i < num_TAs; i++) {
-                sem_post(&sh->exam_ready);
-            }
+    while (true) {
+        // Reap, replace and resize the TA pool (the virtual clock has no
+        // failures and a fixed pool), and notice a helper that died
+        if (!sh->simulate) {
+            supervise(&pool, sh);
+            check_helpers(sh);
         }
 
+        // Retire fully marked exams and keep the ring topped up
+        retire_exams(sh, &sched, &latencies);
+        fill_ring(&exams, sh, ps, &sched);
+
+        bool drained = sh->input_closed.load(std::memory_order_relaxed) &&
+                       sh->retire_seq == sh->load_seq;
+
         // If any TA changed the rubric in shared memory, write it to file
-        int need_save = 0;
-        sem_wait(&sh->mutex_rubric);
-        if (sh->rubric_dirty) {
-            need_save = 1;
-        }
-        sem_post(&sh->mutex_rubric);
+        int save_due_ms = flush_rubric(&rubric_writer, sh, false);
 
-        if (need_save) {
-            log_parent(sh, "Detected rubric change. Saving rubric to file...");
-            sem_wait(&sh->mutex_rubric);
-            if (save_rubric(rubric_path, sh) != 0) {
-                sem_post(&sh->mutex_rubric);
-                log_parent(sh, "Failed to save rubric file");
-            } else {
-                sh->rubric_dirty = 0;
-                sem_post(&sh->mutex_rubric);
-            }
+        if (drained) {
+            makespan_us = clock_us(sh) - start_us;
+            break;
         }
 
-        usleep(200 * 1000); // 200 ms polling
+        // Sleep until a TA reports a finished exam or a rubric change, a TA
+        // exits, a coalesced rubric save is due or it is time to supervise
+        int wait_ms = save_due_ms;
+        if (!sh->simulate && (wait_ms < 0 || wait_ms > HEARTBEAT_MS)) {
+            wait_ms = HEARTBEAT_MS;
+        }
+        int64_t trace_t0 = trace_clock(sh);
+        wait_event(sh, num_TAs, WAIT_PARENT, wait_ms);
+        trace_span(sh, "wait", "sleep", 0, trace_t0);
     }
 
-    // Wake any TAs that might be blocked on exam_ready so they can exit
-    for (int i = 0; i < num_TAs; i++) {
-        sem_post(&sh->exam_ready);
-    }
+    log_parent(sh, EV_TERMINATING);
+
+    // Simulation: the parent steps out so the TAs can run to completion
+    sim_leave(sh, num_TAs);
+
+    // Wait for all TAs to exit (the drainer keeps running)
+    finish_pool(&pool, sh);
+
+    close_exam_source(&exams);
+
+    // Write out anything still pending, including corrections made by a TA
+    // that was reviewing when the last exam finished
+    flush_rubric(&rubric_writer, sh, true);
+    async_io_close(&parent_io);
+
+    log_parent(sh, EV_ALL_DONE);
+    trace_close();
 
-    log_parent(sh, "Termination condition reached. Waiting for TAs...");
+    // Let the drainer and the results writer flush the remaining records
+    // and exit
+    sh->log_closed.store(1, std::memory_order_release);
+    int lost = join_helpers(&drainer, &results_writer, sh);
 
-    // Wait for all TA children to exit
-    int status;
-    while (wait(&status) > 0) {
-        // nothing
+    // If a helper died, log or result records were dropped: the run failed,
+    // and the checkpoint stays
+    if (ps) {
+        close_checkpoint(ps, lost == 0);
     }
 
-    log_parent(sh, "All done.");
+    if (sh->simulate) {
+        print_sim_report(sh, makespan_us);
+    }
+    if (sched.policy != ORDER_FIFO || sched.has_meta) {
+        print_schedule_report(&sched);
+    }
+    if (cfg.stats_path) {
+        write_stats(cfg.stats_path, sh, makespan_us, latencies, io_backend, &sched);
+    }
 
     // Destroy semaphores (while SHM is still attached)
     sem_destroy(&sh->mutex_rubric);
-    sem_destroy(&sh->mutex_questions);
-    sem_destroy(&sh->mutex_log);
-    sem_destroy(&sh->exam_ready);
+    sem_destroy(&sh->work_items);
+    sem_destroy(&sh->parent_wake);
+    for (int i = 0; i <= num_TAs; i++) {
+        sem_destroy(&sim_actor(sh, i)->turn);
+    }
+    for (int i = 0; i < num_TAs; i++) {
+        sem_destroy(&work_deque(sh, i)->lock);
+    }
 
     // Clean up shared memory
-    shmdt(sh);
-    shmctl(shmid, IPC_RMID, nullptr);
+    release_area(sh, shmid);
 
-    return EXIT_SUCCESS;
+    return lost ? EXIT_FAILURE : EXIT_SUCCESS;
 }
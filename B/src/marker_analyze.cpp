@@ -0,0 +1,717 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdarg>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <getopt.h>
+
+/**
+ * marker-analyze: offline analysis of a marker log (Part A or Part B).
+ *
+ * Reads the "[G%05d][TA n] ..." lines in one pass and reconstructs what
+ * every TA and every exam went through: TA utilization (reviewing, marking,
+ * idle), per-exam makespan from load to the last question finished, the
+ * handoff gap from load to the first TA picking the exam up, and the TA on
+ * the critical path of each exam (the one that finished its last question).
+ * It also checks the invariants Part B guarantees and Part A does not, such
+ * as a question being marked twice.
+ *
+ * The logs carry no wall-clock time, so every duration is in log steps:
+ * the distance between G numbers. Memory is bounded: only exams still in
+ * flight (plus a short window of recently completed ones, to recognise late
+ * duplicate marks) and one entry per TA are kept, and distributions go into
+ * fixed-size histograms, so multi-GB logs stream through.
+ *
+ * Every "Loaded exam" line starts a new exam, even for a student number seen
+ * before (a regrade, or simply more than 10,000 exams). TA lines name only
+ * the student, so they go to the oldest open load of that student that is
+ * in the right state for the line.
+ *
+ *   ./marker-analyze tests/partB_5TAs.log
+ *   ./marker 4 data/rubric.txt data/exams | ./marker-analyze -e -
+ *
+ * Exits 0 if the log is clean, 1 if it breaks an invariant, 2 on error
+ * (including input with no log records at all).
+ */
+
+#define RECENT_EXAMS 256        // completed exams kept for late duplicate marks
+
+// --- invariants ---------------------------------------------------------------
+
+enum Violation {
+    V_DOUBLE_MARK,      // the same question of an exam marked more than once
+    V_FINISH_UNMARKED,  // "Finished Qn" without this TA marking Qn of that exam
+    V_OVERLAP,          // TA started a question before finishing its last one
+    V_EARLY_DONE,       // exam reported done with questions still unfinished
+    V_UNKNOWN_EXAM,     // marking an exam that was never loaded
+    V_G_ORDER,          // G number not strictly increasing
+    V_UNFINISHED,       // exam loaded but not completed by the end of the log
+    V_COUNT
+};
+
+static const char *const violation_names[V_COUNT] = {
+    "question marked twice",
+    "finished without marking",
+    "TA marking two questions",
+    "exam done too early",
+    "exam never loaded",
+    "G out of order",
+    "exam never completed",
+};
+
+static int64_t violations[V_COUNT];
+static std::string first_violation[V_COUNT];   // first occurrence, for the report
+
+static void violation(Violation v, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * Count one violation; the first of each kind is kept as an example.
+ */
+static void violation(Violation v, const char *fmt, ...) {
+    if (violations[v]++ > 0) {
+        return;
+    }
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    std::vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    first_violation[v] = buf;
+}
+
+// --- histograms ---------------------------------------------------------------
+
+// Log-linear histogram of non-negative step counts: exact below 16, then 8
+// buckets per power of two (within 12.5%), so percentiles of any number of
+// exams fit in a few hundred counters.
+struct Histogram {
+    std::vector<int64_t> bucket = std::vector<int64_t>(16 + 60 * 8);
+    int64_t n = 0;
+    int64_t sum = 0;
+    int64_t max = 0;
+};
+
+static int bucket_of(int64_t v) {
+    if (v < 16) {
+        return static_cast<int>(v);
+    }
+    int msb = 63 - __builtin_clzll(static_cast<uint64_t>(v));
+    return 16 + (msb - 4) * 8 + static_cast<int>((v >> (msb - 3)) & 7);
+}
+
+static int64_t bucket_value(int b) {
+    if (b < 16) {
+        return b;
+    }
+    int msb = (b - 16) / 8 + 4;
+    return static_cast<int64_t>(8 + (b - 16) % 8) << (msb - 3);
+}
+
+static void hist_add(Histogram *h, int64_t v) {
+    v = std::max<int64_t>(v, 0);
+    h->bucket[bucket_of(v)]++;
+    h->n++;
+    h->sum += v;
+    h->max = std::max(h->max, v);
+}
+
+/**
+ * Value at percentile p (0..100), nearest-rank, to bucket precision.
+ */
+static int64_t hist_percentile(const Histogram &h, double p) {
+    int64_t rank = static_cast<int64_t>(p / 100.0 * h.n + 0.999999);
+    rank = std::max<int64_t>(rank, 1);
+    int64_t seen = 0;
+    for (size_t b = 0; b < h.bucket.size(); b++) {
+        seen += h.bucket[b];
+        if (seen >= rank) {
+            return std::min(bucket_value(static_cast<int>(b)), h.max);
+        }
+    }
+    return h.max;
+}
+
+static void print_hist(const char *name, const Histogram &h) {
+    if (h.n == 0) {
+        std::printf("  %-22s -\n", name);
+        return;
+    }
+    std::printf("  %-22s mean %8.1f  p50 %6lld  p90 %6lld  p99 %6lld  max %6lld\n",
+                name, static_cast<double>(h.sum) / h.n,
+                static_cast<long long>(hist_percentile(h, 50)),
+                static_cast<long long>(hist_percentile(h, 90)),
+                static_cast<long long>(hist_percentile(h, 99)),
+                static_cast<long long>(h.max));
+}
+
+// --- state --------------------------------------------------------------------
+
+// One exam in flight, keyed by its load sequence number
+struct Exam {
+    int64_t key = -1;               // load sequence number
+    std::string student;
+    int64_t loaded_g = -1;          // -1 if its load line was not seen
+    int64_t first_start_g = -1;     // first "Starting work" on it
+    int64_t last_finish_g = -1;
+    int     last_ta = -1;           // TA that finished the most recent question
+    int     finished = 0;           // distinct questions finished
+    bool    complete = false;
+    std::vector<uint8_t> marks;     // per question: "Marking" lines seen (saturating)
+    std::vector<uint8_t> done;      // per question: finished
+    std::vector<std::pair<int, int64_t>> ta_busy; // steps each TA spent on it
+};
+
+// One TA
+struct Ta {
+    int64_t first_g = -1;
+    int64_t last_g = -1;
+    int64_t review = 0;             // steps between "Checking rubric" and its outcome
+    int64_t mark = 0;               // steps between "Marking" and "Finished"
+    int64_t idle = 0;               // steps after "Waiting for next exam..."
+    int64_t check_g = -1;           // open rubric check
+    int64_t mark_g = -1;            // open question
+    int     mark_q = 0;
+    std::string mark_student;
+    int64_t wait_g = -1;            // waiting since
+    int64_t exam = -1;              // key of the exam being reviewed for
+    int64_t finished_exam = -1;     // key of the exam of its last finished question
+    int64_t marked = 0;
+    int64_t exams = 0;              // "Starting work" lines
+    int64_t critical = 0;           // exams it finished last
+};
+
+struct Analysis {
+    int num_questions = 0;          // -q, or the highest Q seen in a rubric check
+    bool fixed_questions = false;
+    bool list_exams = false;        // -e: one line per completed exam
+    int64_t lines = 0;
+    int64_t ignored = 0;            // lines that are not log records
+    int64_t first_g = -1;
+    int64_t last_g = -1;            // highest G seen
+    int64_t prev_g = -1;            // G of the previous record
+    int64_t loaded = 0;
+    int64_t completed = 0;
+    int64_t next_key = 0;
+    std::map<int64_t, Exam> open;   // in flight, oldest load first
+    std::unordered_map<std::string, std::vector<int64_t>> loads; // open keys per student
+    std::deque<Exam> recent;        // last RECENT_EXAMS completed exams
+    std::map<int, Ta> tas;
+    Histogram makespan;             // load -> last question finished
+    Histogram handoff;              // load -> first TA starts on it
+    Histogram critical_share;       // % of the makespan the critical TA was busy on it
+};
+
+/**
+ * Start a new in-flight exam for this student.
+ */
+static Exam *new_exam(Analysis *a, const std::string &student) {
+    int64_t key = a->next_key++;
+    Exam &e = a->open[key];
+    e.key = key;
+    e.student = student;
+    a->loads[student].push_back(key);
+    return &e;
+}
+
+/**
+ * The in-flight exam with this key, or nullptr once it has completed.
+ */
+static Exam *open_exam(Analysis *a, int64_t key) {
+    auto it = a->open.find(key);
+    return it != a->open.end() ? &it->second : nullptr;
+}
+
+/**
+ * The oldest open load of this student for which fits(exam) holds, else its
+ * oldest open load, else its most recently completed exam. nullptr if the
+ * student has none.
+ */
+template <typename Fits>
+static Exam *find_exam(Analysis *a, const std::string &student, Fits fits) {
+    auto it = a->loads.find(student);
+    if (it != a->loads.end()) {
+        for (int64_t key : it->second) {
+            Exam *e = &a->open[key];
+            if (fits(*e)) {
+                return e;
+            }
+        }
+        return &a->open[it->second.front()];
+    }
+    for (auto r = a->recent.rbegin(); r != a->recent.rend(); ++r) {
+        if (r->student == student) {
+            return &*r;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Drop an exam from its student's open loads.
+ */
+static void forget_load(Analysis *a, const Exam &e) {
+    auto it = a->loads.find(e.student);
+    if (it == a->loads.end()) {
+        return;
+    }
+    std::vector<int64_t> &keys = it->second;
+    keys.erase(std::remove(keys.begin(), keys.end(), e.key), keys.end());
+    if (keys.empty()) {
+        a->loads.erase(it);
+    }
+}
+
+static void add_busy(Exam *e, int ta, int64_t steps) {
+    for (auto &p : e->ta_busy) {
+        if (p.first == ta) {
+            p.second += steps;
+            return;
+        }
+    }
+    e->ta_busy.push_back({ta, steps});
+}
+
+/**
+ * Every question of an in-flight exam is finished: record its makespan,
+ * handoff and critical TA, and move it to the recent window.
+ */
+static void complete_exam(Analysis *a, Exam *e) {
+    e->complete = true;
+    a->completed++;
+    int64_t makespan = e->loaded_g >= 0 ? e->last_finish_g - e->loaded_g : -1;
+    int64_t handoff  = (e->loaded_g >= 0 && e->first_start_g >= 0)
+                           ? e->first_start_g - e->loaded_g : -1;
+    int64_t crit_busy = 0;
+    for (const auto &p : e->ta_busy) {
+        if (p.first == e->last_ta) {
+            crit_busy = p.second;
+        }
+    }
+    if (e->last_ta >= 0) {
+        a->tas[e->last_ta].critical++;
+    }
+    if (makespan >= 0) {
+        hist_add(&a->makespan, makespan);
+        if (makespan > 0) {
+            hist_add(&a->critical_share, 100 * crit_busy / makespan);
+        }
+    }
+    if (handoff >= 0) {
+        hist_add(&a->handoff, handoff);
+    }
+    if (a->list_exams) {
+        std::printf("exam %s: loaded G%05lld, handoff %lld, makespan %lld, %zu TAs,"
+                    " critical TA %d (busy %lld)\n",
+                    e->student.c_str(), static_cast<long long>(e->loaded_g),
+                    static_cast<long long>(handoff), static_cast<long long>(makespan),
+                    e->ta_busy.size(), e->last_ta, static_cast<long long>(crit_busy));
+    }
+
+    forget_load(a, *e);
+    int64_t key = e->key;
+    a->recent.push_back(std::move(*e));
+    a->open.erase(key);
+    if (a->recent.size() > RECENT_EXAMS) {
+        a->recent.pop_front();
+    }
+}
+
+/**
+ * Grow an exam's per-question arrays to hold question q (1-based).
+ */
+static void ensure_question(Exam *e, int q) {
+    if (static_cast<int>(e->marks.size()) < q) {
+        e->marks.resize(q, 0);
+        e->done.resize(q, 0);
+    }
+}
+
+// --- parsing ------------------------------------------------------------------
+
+/**
+ * Split "[G00012][TA 3] msg" / "[G00012][PARENT] msg" into G, TA id (-1 for
+ * the parent) and the message. Returns false for any other line.
+ */
+static bool parse_prefix(const char *line, int64_t *g, int *ta, const char **msg) {
+    if (std::strncmp(line, "[G", 2) != 0) {
+        return false;
+    }
+    char *end;
+    *g = std::strtoll(line + 2, &end, 10);
+    if (end == line + 2 || std::strncmp(end, "][", 2) != 0) {
+        return false;
+    }
+    const char *who = end + 2;
+    if (std::strncmp(who, "PARENT] ", 8) == 0) {
+        *ta = -1;
+        *msg = who + 8;
+        return true;
+    }
+    if (std::strncmp(who, "TA ", 3) != 0) {
+        return false;
+    }
+    *ta = static_cast<int>(std::strtol(who + 3, &end, 10));
+    if (std::strncmp(end, "] ", 2) != 0) {
+        return false;
+    }
+    *msg = end + 2;
+    return true;
+}
+
+/**
+ * Student number following "student " in msg (up to a space, comma, '.'
+ * or ')'), or "" if there is none.
+ */
+static std::string student_of(const char *msg) {
+    const char *s = std::strstr(msg, "student ");
+    if (!s) {
+        return "";
+    }
+    s += 8;
+    return std::string(s, std::strcspn(s, " ,.)\n"));
+}
+
+static void parent_line(Analysis *a, int64_t g, const char *msg) {
+    int q, id;
+    if (std::sscanf(msg, "TA %d died", &id) == 1) {
+        // Whatever it had open is reclaimed; a respawned TA starts clean
+        Ta &ta = a->tas[id];
+        ta.check_g = -1;
+        ta.mark_g = -1;
+        ta.wait_g = -1;
+        return;
+    }
+    if (std::sscanf(msg, "Requeued Q%d for student", &q) == 1 && q > 0) {
+        // The question goes back on the queue: the next "Marking" is not a repeat
+        const char *from = std::strstr(msg, " from TA ");
+        Exam *e = find_exam(a, student_of(msg), [q](const Exam &x) {
+            return q <= static_cast<int>(x.marks.size()) && x.marks[q - 1] > 0 &&
+                   !x.done[q - 1];
+        });
+        if (e && q <= static_cast<int>(e->marks.size()) && e->marks[q - 1] > 0) {
+            e->marks[q - 1]--;
+        }
+        if (from) {
+            a->tas[std::atoi(from + 9)].mark_g = -1;
+        }
+        return;
+    }
+    if (std::sscanf(msg, "Requeued review of Q%d for student", &q) == 1) {
+        // --review=partitioned: the rubric check goes back on the queue
+        const char *from = std::strstr(msg, " from TA ");
+        if (from) {
+            a->tas[std::atoi(from + 9)].check_g = -1;
+        }
+        return;
+    }
+    if (std::sscanf(msg, "Q%d for student", &q) == 1 && q > 0 &&
+        (std::strstr(msg, "marked before the restart") ||
+         std::strstr(msg, "before it died"))) {
+        // --persist resume: this question was marked by the previous run;
+        // or a TA died after marking it, before it could say so
+        Exam *e = find_exam(a, student_of(msg), [q](const Exam &x) {
+            return q > static_cast<int>(x.done.size()) || !x.done[q - 1];
+        });
+        if (e && !e->complete) {
+            ensure_question(e, q);
+            if (!e->done[q - 1]) {
+                e->done[q - 1] = 1;
+                e->marks[q - 1] = 1;
+                e->finished++;
+            }
+            e->last_finish_g = g;
+            if (a->num_questions > 0 && e->finished >= a->num_questions) {
+                complete_exam(a, e);
+            }
+        }
+        return;
+    }
+    if (std::strncmp(msg, "Loaded exam ", 12) != 0) {
+        return;
+    }
+    std::string student = student_of(msg);
+    if (student == "9999") {
+        return; // sentinel, nothing to mark
+    }
+    // Always a new exam: the same student may be marked again (a regrade),
+    // even while an earlier exam of theirs is still in flight
+    a->loaded++;
+    new_exam(a, student)->loaded_g = g;
+}
+
+static void ta_line(Analysis *a, int64_t g, int id, const char *msg) {
+    Ta &ta = a->tas[id];
+    if (ta.first_g < 0) {
+        ta.first_g = g;
+    }
+    ta.last_g = g;
+    if (ta.wait_g >= 0 && std::strncmp(msg, "Waiting", 7) != 0) {
+        ta.idle += std::max<int64_t>(g - ta.wait_g, 0);
+        ta.wait_g = -1;
+    }
+
+    int q;
+    if (std::strncmp(msg, "Starting work on student ", 25) == 0) {
+        ta.exams++;
+        Exam *e = find_exam(a, student_of(msg),
+                            [](const Exam &x) { return x.first_start_g < 0; });
+        ta.exam = e && !e->complete ? e->key : -1;
+        if (e && e->first_start_g < 0) {
+            e->first_start_g = g;
+        }
+    } else if (std::sscanf(msg, "Checking rubric for Q%d", &q) == 1) {
+        ta.check_g = g;
+        if (!a->fixed_questions && q > a->num_questions) {
+            a->num_questions = q;
+        }
+    } else if (std::strncmp(msg, "Correcting rubric Q", 19) == 0 ||
+               std::strncmp(msg, "Rubric for Q", 12) == 0) {
+        if (ta.check_g >= 0) {
+            int64_t steps = std::max<int64_t>(g - ta.check_g, 0);
+            ta.review += steps;
+            Exam *e = open_exam(a, ta.exam);
+            if (e) {
+                add_busy(e, id, steps);
+            }
+            ta.check_g = -1;
+        }
+    } else if (std::sscanf(msg, "Marking Q%d for student", &q) == 1 && q > 0) {
+        std::string student = student_of(msg);
+        if (ta.mark_g >= 0) {
+            violation(V_OVERLAP, "G%05lld: TA %d marks Q%d of %s with Q%d of %s open",
+                      static_cast<long long>(g), id, q, student.c_str(), ta.mark_q,
+                      ta.mark_student.c_str());
+        }
+        Exam *e = find_exam(a, student, [q](const Exam &x) {
+            return q > static_cast<int>(x.marks.size()) || x.marks[q - 1] == 0;
+        });
+        if (!e) {
+            violation(V_UNKNOWN_EXAM, "G%05lld: TA %d marks Q%d of %s, never loaded",
+                      static_cast<long long>(g), id, q, student.c_str());
+            e = new_exam(a, student);
+        }
+        ensure_question(e, q);
+        if (e->marks[q - 1] > 0) {
+            violation(V_DOUBLE_MARK, "G%05lld: Q%d of %s marked again by TA %d",
+                      static_cast<long long>(g), q, student.c_str(), id);
+        }
+        if (e->marks[q - 1] < UINT8_MAX) {
+            e->marks[q - 1]++;
+        }
+        ta.mark_g = g;
+        ta.mark_q = q;
+        ta.mark_student = student;
+    } else if (std::sscanf(msg, "Finished Q%d for student", &q) == 1 && q > 0) {
+        std::string student = student_of(msg);
+        Exam *e = find_exam(a, student, [q](const Exam &x) {
+            return q <= static_cast<int>(x.marks.size()) && x.marks[q - 1] > 0 &&
+                   !x.done[q - 1];
+        });
+        ta.finished_exam = e && !e->complete ? e->key : -1;
+        if (ta.mark_g < 0 || ta.mark_q != q || ta.mark_student != student || !e) {
+            violation(V_FINISH_UNMARKED, "G%05lld: TA %d finished Q%d of %s",
+                      static_cast<long long>(g), id, q, student.c_str());
+        } else {
+            int64_t steps = std::max<int64_t>(g - ta.mark_g, 0);
+            ta.mark += steps;
+            ta.marked++;
+            if (!e->complete) {
+                add_busy(e, id, steps);
+            }
+        }
+        ta.mark_g = -1;
+        if (e && !e->complete) {
+            ensure_question(e, q);
+            if (!e->done[q - 1]) {
+                e->done[q - 1] = 1;
+                e->finished++;
+            }
+            e->last_finish_g = g;
+            e->last_ta = id;
+            if (a->num_questions > 0 && e->finished >= a->num_questions) {
+                complete_exam(a, e);
+            }
+        }
+    } else if (std::strncmp(msg, "All questions for student ", 26) == 0) {
+        // Logged by the TA that finished the exam's last question
+        Exam *e = open_exam(a, ta.finished_exam);
+        if (e && e->student == student_of(msg)) {
+            violation(V_EARLY_DONE, "G%05lld: TA %d reports %s done with %d of %d"
+                      " questions finished", static_cast<long long>(g), id,
+                      e->student.c_str(), e->finished, a->num_questions);
+        }
+    } else if (std::strncmp(msg, "Waiting", 7) == 0) {
+        ta.wait_g = g;
+    }
+}
+
+/**
+ * Feed one log line to the analysis.
+ */
+static void analyze_line(Analysis *a, const char *line) {
+    a->lines++;
+    int64_t g;
+    int ta;
+    const char *msg;
+    if (!parse_prefix(line, &g, &ta, &msg)) {
+        a->ignored++;
+        return;
+    }
+    if (a->prev_g >= 0 && g <= a->prev_g) {
+        violation(V_G_ORDER, "G%05lld follows G%05lld", static_cast<long long>(g),
+                  static_cast<long long>(a->prev_g));
+    }
+    a->prev_g = g;
+    if (a->first_g < 0) {
+        a->first_g = g;
+    }
+    a->last_g = std::max(a->last_g, g);
+
+    if (ta < 0) {
+        parent_line(a, g, msg);
+    } else {
+        ta_line(a, g, ta, msg);
+    }
+}
+
+// --- report -------------------------------------------------------------------
+
+static double pct(int64_t part, int64_t whole) {
+    return whole > 0 ? 100.0 * part / whole : 0.0;
+}
+
+static void print_report(Analysis *a, const char *name) {
+    // Whatever is still in flight never completed
+    for (const auto &kv : a->open) {
+        violation(V_UNFINISHED, "student %s: %d of %d questions finished",
+                  kv.second.student.c_str(), kv.second.finished, a->num_questions);
+    }
+    int64_t span = a->last_g - a->first_g;
+
+    std::printf("%s: %lld lines (%lld not log records), G%05lld..G%05lld, %zu TAs,"
+                " %d questions\n", name, static_cast<long long>(a->lines),
+                static_cast<long long>(a->ignored), static_cast<long long>(a->first_g),
+                static_cast<long long>(a->last_g), a->tas.size(), a->num_questions);
+    std::printf("exams: %lld loaded, %lld completed, %zu unfinished"
+                "   (durations in log steps)\n\n",
+                static_cast<long long>(a->loaded), static_cast<long long>(a->completed),
+                a->open.size());
+
+    std::printf("%3s %7s %7s %7s %7s %6s %6s %6s %7s %6s %8s\n", "TA", "span", "review",
+                "mark", "idle", "busy%", "idle%", "util%", "marked", "exams", "critical");
+    for (const auto &kv : a->tas) {
+        const Ta &t = kv.second;
+        int64_t life = t.last_g - t.first_g;
+        std::printf("%3d %7lld %7lld %7lld %7lld %6.1f %6.1f %6.1f %7lld %6lld %8lld\n",
+                    kv.first, static_cast<long long>(life),
+                    static_cast<long long>(t.review), static_cast<long long>(t.mark),
+                    static_cast<long long>(t.idle), pct(t.review + t.mark, life),
+                    pct(t.idle, life), pct(t.review + t.mark, span),
+                    static_cast<long long>(t.marked), static_cast<long long>(t.exams),
+                    static_cast<long long>(t.critical));
+    }
+    std::printf("  busy%%/idle%% are of the TA's own span, util%% of the whole log;"
+                " critical = exams it finished last\n\n");
+
+    print_hist("exam makespan", a->makespan);
+    print_hist("handoff (load->start)", a->handoff);
+    print_hist("critical TA busy %", a->critical_share);
+
+    std::printf("\ninvariants:\n");
+    bool clean = true;
+    for (int v = 0; v < V_COUNT; v++) {
+        if (violations[v] == 0) {
+            continue;
+        }
+        clean = false;
+        std::printf("  %-26s %8lld   first: %s\n", violation_names[v],
+                    static_cast<long long>(violations[v]), first_violation[v].c_str());
+    }
+    if (clean) {
+        std::printf("  all hold\n");
+    }
+}
+
+static void usage(const char *prog) {
+    std::fprintf(stderr,
+                 "Usage: %s [options] <log_file | ->\n"
+                 "Options:\n"
+                 "  -q, --questions=N   questions per exam (default: highest Q"
+                 " checked in a\n"
+                 "                      rubric review)\n"
+                 "  -e, --exams         print one line per exam as it completes\n",
+                 prog);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        {"questions", required_argument, nullptr, 'q'},
+        {"exams",     no_argument,       nullptr, 'e'},
+        {nullptr, 0, nullptr, 0},
+    };
+    Analysis a;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "q:e", long_opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'q':
+            a.num_questions = std::atoi(optarg);
+            a.fixed_questions = true;
+            if (a.num_questions < 1) {
+                std::fprintf(stderr, "--questions must be >= 1\n");
+                return 2;
+            }
+            break;
+        case 'e':
+            a.list_exams = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    const char *path = argv[optind];
+    FILE *f = std::strcmp(path, "-") == 0 ? stdin : std::fopen(path, "r");
+    if (!f) {
+        std::perror(path);
+        return 2;
+    }
+    char *line = nullptr;
+    size_t cap = 0;
+    while (getline(&line, &cap, f) != -1) {
+        analyze_line(&a, line);
+    }
+    bool failed = std::ferror(f);
+    std::free(line);
+    if (f != stdin) {
+        std::fclose(f);
+    }
+    if (failed) {
+        std::perror(path);
+        return 2;
+    }
+
+    const char *name = std::strcmp(path, "-") == 0 ? "stdin" : path;
+    if (a.lines == a.ignored) {
+        // Nothing checked: a log in some other format must not pass as clean
+        std::fprintf(stderr, "%s: no log records\n", name);
+        return 2;
+    }
+    print_report(&a, name);
+    for (int v = 0; v < V_COUNT; v++) {
+        if (violations[v] > 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <errno.h>
+#include <getopt.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "shared_area.h"
+
+/**
+ * marker-stat: live view of a running marker, like top.
+ *
+ * Attaches the marker's shared segment read-only and prints the per-TA
+ * metrics every interval: what each TA is doing, questions marked and
+ * the rate since the last sample, rubric checks and corrections, and the
+ * share of the interval spent busy, idle and blocked on a lock. It only
+ * reads relaxed atomics; it never takes a semaphore or writes the segment,
+ * so watching a run does not change it.
+ *
+ *   ./marker-stat                 # the most recent marker of this user
+ *   ./marker-stat -i 0.5 98310    # a given segment id, every 0.5 s
+ */
+
+static const char *state_name(int state) {
+    switch (state) {
+    case TA_STARTING:  return "starting";
+    case TA_WAITING:   return "waiting";
+    case TA_REVIEWING: return "reviewing";
+    case TA_MARKING:   return "marking";
+    case TA_BLOCKED:   return "blocked";
+    case TA_EXITED:    return "exited";
+    case TA_OFF:       return "off";
+    case TA_DEAD:      return "dead";
+    default:           return "?";
+    }
+}
+
+/**
+ * Attach segment shmid read-only if it is a marker segment of a layout
+ * version we understand. Returns nullptr otherwise.
+ */
+static const SharedArea *attach_marker(int shmid, bool verbose) {
+    struct shmid_ds ds;
+    if (shmctl(shmid, IPC_STAT, &ds) != 0) {
+        if (verbose) {
+            std::perror("shmctl");
+        }
+        return nullptr;
+    }
+    if (ds.shm_segsz < sizeof(SharedArea)) {
+        if (verbose) {
+            std::fprintf(stderr, "Segment %d is not a marker segment\n", shmid);
+        }
+        return nullptr;
+    }
+    void *mem = shmat(shmid, nullptr, SHM_RDONLY);
+    if (mem == reinterpret_cast<void *>(-1)) {
+        if (verbose) {
+            std::perror("shmat");
+        }
+        return nullptr;
+    }
+    const SharedArea *sh = static_cast<const SharedArea *>(mem);
+    if (sh->magic != SHARED_AREA_MAGIC || sh->version != SHARED_AREA_VERSION ||
+        sh->layout.total != ds.shm_segsz) {
+        if (verbose) {
+            std::fprintf(stderr, "Segment %d is not a marker segment (or a different"
+                                 " version)\n", shmid);
+        }
+        shmdt(mem);
+        return nullptr;
+    }
+    return sh;
+}
+
+/**
+ * Find the most recently created marker segment of this user.
+ * Returns its id, or -1 if there is none.
+ */
+static int find_marker() {
+    struct shm_info info;
+    int max_idx = shmctl(0, SHM_INFO, reinterpret_cast<struct shmid_ds *>(&info));
+    int best = -1;
+    time_t best_ctime = 0;
+    for (int i = 0; i <= max_idx; i++) {
+        struct shmid_ds ds;
+        int shmid = shmctl(i, SHM_STAT, &ds);
+        if (shmid < 0 || ds.shm_perm.uid != getuid() ||
+            (ds.shm_perm.mode & SHM_DEST) || ds.shm_ctime < best_ctime) {
+            continue;
+        }
+        const SharedArea *sh = attach_marker(shmid, false);
+        if (sh) {
+            shmdt(sh);
+            best = shmid;
+            best_ctime = ds.shm_ctime;
+        }
+    }
+    return best;
+}
+
+// One reading of a TA's counters
+struct Sample {
+    int64_t marked, checks, corrections, steals;
+    int64_t busy_us, idle_us, lock_wait_us;
+};
+
+/**
+ * Busy time of TA t so far, counting the review or mark in hand up to now
+ * (busy_us is only credited once one is over). busy_since_us works as a
+ * seqlock around the credit: retry while one is being credited or if one
+ * ended or started in between. Mid-credit, yield so the TA can finish it.
+ */
+static int64_t busy_so_far(const TaStats *t) {
+    while (true) {
+        int64_t since = t->busy_since_us.load(std::memory_order_acquire);
+        if (since < 0) {
+            sched_yield();
+            continue;
+        }
+        int64_t busy = metric(t->busy_us);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (t->busy_since_us.load(std::memory_order_relaxed) == since) {
+            return busy + (since > 0 ? std::max<int64_t>(now_us() - since, 0) : 0);
+        }
+    }
+}
+
+static Sample take_sample(const SharedArea *sh, int ta) {
+    const TaStats *t = ta_stats(const_cast<SharedArea *>(sh), ta);
+    return {metric(t->questions_marked), metric(t->rubric_checks),
+            metric(t->corrections), metric(t->steals),
+            busy_so_far(t), metric(t->idle_us), metric(t->lock_wait_us)};
+}
+
+/**
+ * The clock the TA timings are in: virtual with --simulate.
+ */
+static int64_t run_clock(const SharedArea *sh) {
+    if (sh->simulate) {
+        return __atomic_load_n(&sh->sim_now_us, __ATOMIC_RELAXED);
+    }
+    return now_us();
+}
+
+static bool marker_gone(const SharedArea *sh, int shmid) {
+    struct shmid_ds ds;
+    return sh->log_closed.load(std::memory_order_relaxed) ||
+           shmctl(shmid, IPC_STAT, &ds) != 0 || (ds.shm_perm.mode & SHM_DEST) ||
+           (kill(sh->parent_pid, 0) != 0 && errno == ESRCH);
+}
+
+static double pct(int64_t part, int64_t whole) {
+    return whole > 0 ? 100.0 * part / whole : 0.0;
+}
+
+static void print_screen(const SharedArea *sh, int shmid, std::vector<Sample> &prev,
+                         int64_t dt_us, bool clear) {
+    if (clear) {
+        std::printf("\033[H\033[J");
+    }
+    int load_seq   = __atomic_load_n(&sh->load_seq, __ATOMIC_RELAXED);
+    int retire_seq = __atomic_load_n(&sh->retire_seq, __ATOMIC_RELAXED);
+    std::printf("marker pid %d, segment %d, %s mode%s, %d questions, up %.1f s\n",
+                static_cast<int>(sh->parent_pid), shmid,
+                sh->mode == MODE_THREADS ? "threads" : "process",
+                sh->simulate ? " (simulated time)" : "",
+                sh->num_questions, (now_us() - sh->started_us) / 1e6);
+    std::printf("TAs: %d running (%d-%d), %d started, %d died\n",
+                sh->running_TAs.load(std::memory_order_relaxed), sh->min_TAs, sh->num_TAs,
+                sh->ta_spawns.load(std::memory_order_relaxed),
+                sh->ta_deaths.load(std::memory_order_relaxed));
+    std::printf("exams: %d loaded, %d retired, input %s   rubric version %llu   "
+                "log lines %llu\n",
+                load_seq, retire_seq,
+                sh->input_closed.load(std::memory_order_relaxed) ? "closed" : "open",
+                static_cast<unsigned long long>(
+                    sh->rubric_version.load(std::memory_order_relaxed)),
+                static_cast<unsigned long long>(
+                    sh->log_counter.load(std::memory_order_relaxed)));
+    std::printf("%3s %-9s %5s %7s %6s %7s %6s %6s %6s %6s %6s\n", "TA", "state", "exam",
+                "marked", "q/s", "checks", "fixes", "steals", "busy%", "idle%", "blkd%");
+
+    Sample total = {};
+    for (int i = 0; i < sh->num_TAs; i++) {
+        const TaStats *t = ta_stats(const_cast<SharedArea *>(sh), i);
+        Sample now = take_sample(sh, i);
+        Sample &was = prev[i];
+        int exam = t->current_exam.load(std::memory_order_relaxed);
+        char exam_str[12] = "-";
+        if (exam >= 0) {
+            std::snprintf(exam_str, sizeof(exam_str), "%04d", exam);
+        }
+        std::printf("%3d %-9s %5s %7lld %6.1f %7lld %6lld %6lld %6.1f %6.1f %6.1f\n",
+                    i, state_name(t->state.load(std::memory_order_relaxed)), exam_str,
+                    static_cast<long long>(now.marked),
+                    dt_us > 0 ? (now.marked - was.marked) * 1e6 / dt_us : 0.0,
+                    static_cast<long long>(now.checks),
+                    static_cast<long long>(now.corrections),
+                    static_cast<long long>(now.steals),
+                    pct(now.busy_us - was.busy_us, dt_us),
+                    pct(now.idle_us - was.idle_us, dt_us),
+                    pct(now.lock_wait_us - was.lock_wait_us, dt_us));
+        total.marked += now.marked - was.marked;
+        was = now;
+    }
+    std::printf("total %.1f questions/s\n", dt_us > 0 ? total.marked * 1e6 / dt_us : 0.0);
+    std::fflush(stdout);
+}
+
+static void usage(const char *prog) {
+    std::fprintf(stderr,
+                 "Usage: %s [options] [shmid]\n"
+                 "Options:\n"
+                 "  -i, --interval=SEC    refresh every SEC seconds (default 1)\n"
+                 "  -n, --count=N         stop after N refreshes (default: until"
+                 " marker exits)\n"
+                 "Without shmid, watches the most recent marker of this user.\n",
+                 prog);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        {"interval", required_argument, nullptr, 'i'},
+        {"count",    required_argument, nullptr, 'n'},
+        {nullptr, 0, nullptr, 0},
+    };
+    double interval = 1.0;
+    long count = 0;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "i:n:", long_opts, nullptr)) != -1) {
+        switch (opt) {
+        case 'i':
+            interval = std::atof(optarg);
+            if (interval <= 0) {
+                std::fprintf(stderr, "--interval must be > 0\n");
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'n':
+            count = std::atol(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind > 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int shmid = (argc - optind == 1) ? std::atoi(argv[optind]) : find_marker();
+    if (shmid < 0) {
+        std::fprintf(stderr, "No running marker found\n");
+        return EXIT_FAILURE;
+    }
+    const SharedArea *sh = attach_marker(shmid, true);
+    if (!sh) {
+        return EXIT_FAILURE;
+    }
+
+    // The first refresh reports rates since each TA started
+    std::vector<Sample> prev(sh->num_TAs);
+    int64_t last = sh->simulate ? 0 : sh->started_us;
+    bool clear = isatty(STDOUT_FILENO);
+
+    for (long n = 1; ; n++) {
+        bool gone = marker_gone(sh, shmid);
+        int64_t t = run_clock(sh);
+        print_screen(sh, shmid, prev, t - last, clear);
+        last = t;
+        if (gone) {
+            std::printf("marker has finished\n");
+            break;
+        }
+        if (count > 0 && n >= count) {
+            break;
+        }
+        usleep(static_cast<useconds_t>(interval * 1e6));
+    }
+
+    shmdt(sh);
+    return EXIT_SUCCESS;
+}
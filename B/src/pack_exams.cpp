@@ -0,0 +1,142 @@
+#define _XOPEN_SOURCE 700
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "exam_batch.h"
+
+/**
+ * pack_exams: convert an exam directory (as written by generate_exams.sh)
+ * into one packed batch file that marker can map instead of opening every
+ * exam. See exam_batch.h for the format.
+ *
+ *   ./pack_exams data/exams data/exams.exb
+ *   ./marker 3 data/rubric.txt data/exams.exb
+ */
+
+/**
+ * Read the whole file at path into out. Returns 0 on success, -1 otherwise.
+ */
+static int read_file(const std::string &path, std::string *out) {
+    FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f) {
+        std::perror(path.c_str());
+        return -1;
+    }
+    char buf[4096];
+    size_t n;
+    out->clear();
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) {
+        out->append(buf, n);
+    }
+    bool failed = std::ferror(f);
+    std::fclose(f);
+    if (failed) {
+        std::perror(path.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Write the batch to path.tmp, fsync it and rename it over path, so a
+ * reader never maps a half-written batch.
+ */
+static int write_batch(const char *path, const std::string &data) {
+    std::string tmp = std::string(path) + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::perror(tmp.c_str());
+        return -1;
+    }
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0) {
+            std::perror("write batch");
+            close(fd);
+            unlink(tmp.c_str());
+            return -1;
+        }
+        done += n;
+    }
+    if (fsync(fd) != 0 || close(fd) != 0) {
+        std::perror("fsync batch");
+        unlink(tmp.c_str());
+        return -1;
+    }
+    if (rename(tmp.c_str(), path) != 0) {
+        std::perror("rename batch");
+        unlink(tmp.c_str());
+        return -1;
+    }
+    return 0;
+}
+
+static void pad_to_8(std::string *data) {
+    data->append((8 - data->size() % 8) % 8, '\0');
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::fprintf(stderr, "Usage: %s <exam_dir> <batch_file>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char *exam_dir = argv[1];
+    const char *out_path = argv[2];
+
+    std::vector<std::string> names;
+    if (list_exam_dir(exam_dir, &names) != 0) {
+        std::perror(exam_dir);
+        return EXIT_FAILURE;
+    }
+
+    // Header first (filled in at the end), then records, then the index
+    std::string data(sizeof(ExamBatchHeader), '\0');
+    std::vector<uint64_t> offsets;
+    std::string text;
+    for (const std::string &name : names) {
+        if (read_file(std::string(exam_dir) + "/" + name, &text) != 0) {
+            return EXIT_FAILURE;
+        }
+        if (text.size() < 4 || name.size() > UINT16_MAX) {
+            std::fprintf(stderr, "Skipping %s: no student number\n", name.c_str());
+            continue;
+        }
+
+        ExamRecord rec;
+        std::memset(&rec, 0, sizeof(rec));
+        std::memcpy(rec.student_id, text.data(), 4);
+        rec.name_len = static_cast<uint16_t>(name.size());
+        rec.text_len = static_cast<uint32_t>(text.size());
+
+        offsets.push_back(data.size());
+        data.append(reinterpret_cast<const char *>(&rec), sizeof(rec));
+        data.append(name);
+        data.append(text);
+        pad_to_8(&data);
+    }
+
+    ExamBatchHeader h;
+    std::memcpy(h.magic, EXAM_BATCH_MAGIC, 8);
+    h.version   = EXAM_BATCH_VERSION;
+    h.count     = static_cast<uint32_t>(offsets.size());
+    h.index_off = data.size();
+    data.append(reinterpret_cast<const char *>(offsets.data()),
+                offsets.size() * sizeof(uint64_t));
+    h.size = data.size();
+    std::memcpy(&data[0], &h, sizeof(h));
+
+    if (write_batch(out_path, data) != 0) {
+        return EXIT_FAILURE;
+    }
+    std::printf("Packed %u exams from %s into %s (%zu bytes)\n",
+                h.count, exam_dir, out_path, data.size());
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,485 @@
+#ifndef SHARED_AREA_H
+#define SHARED_AREA_H
+
+/**
+ * Layout of the shared segment used by marker (and read by marker-stat):
+ * the SharedArea header followed by runtime-sized arrays at ShmLayout
+ * offsets, plus the accessors for them.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <semaphore.h>
+#include <sys/types.h>
+
+#define LOG_RING_SIZE 1024      // records per producer log ring (power of two)
+#define RESULT_RING_SIZE 4096   // records in the shared results ring (power of two)
+#define CACHE_LINE 64           // unit the shared segment is laid out in
+#define SHARED_AREA_MAGIC   0x4d524b52u // "MRKR", first word of the segment
+#define SHARED_AREA_VERSION 10          // bump when the layout changes
+
+// How TAs, the log drainer and the results writer run: forked processes, or
+// threads of one process. Either way they share one SysV segment
+// (marker-stat attaches it).
+enum RunMode { MODE_PROCESS, MODE_THREADS };
+
+// How review and marking delays are drawn
+enum DelayDist { DIST_UNIFORM, DIST_EXPONENTIAL, DIST_FIXED };
+
+// Which rubric entries a TA checks before starting on an exam (--review)
+enum ReviewPolicy {
+    REVIEW_FULL,    // all of them, every exam
+    REVIEW_CHANGED, // those changed since this TA last checked them
+    REVIEW_EVERY,   // all of them on every review_every-th exam, none otherwise
+    REVIEW_PARTITIONED, // each entry once per exam, by whichever TA claims it;
+                        // the exam's questions are queued once all are checked
+};
+
+struct DelaySpec {
+    int min_ms;
+    int max_ms;
+};
+
+// One in-flight exam. Exam number seq lives in slot seq % ring_slots; its
+// question and review states are row seq % ring_slots of the states array.
+struct alignas(CACHE_LINE) ExamSlot {
+    char student_id[5];                 // "0001" - 4 digits + '\0'
+    std::atomic<int> questions_left;    // questions not yet in state 2
+    std::atomic<int> exam_done;         // 1 = exam fully marked, parent may reuse slot
+    std::atomic<int> reviews_left;      // --review=partitioned: rubric entries still to
+                                        // check; -1 once its questions are queued
+    int64_t loaded_us;                  // clock_us() when published to the TAs
+    int64_t done_us;                    // clock_us() when the last question finished
+};
+
+// What a TA is doing right now (TaStats::state). TA_OFF and TA_DEAD are set
+// by the parent for slots with no TA running.
+enum TaState { TA_STARTING, TA_WAITING, TA_REVIEWING, TA_MARKING, TA_BLOCKED, TA_EXITED,
+               TA_OFF, TA_DEAD };
+
+// Per-TA metrics for --stats and marker-stat. Each entry is written only
+// by its own TA, through metric_add()/metric_set(): relaxed loads and
+// stores, no locked instruction on the hot path, and any other process may
+// read them at any time without a lock. Own cache lines per TA so TAs do
+// not invalidate each other's counters.
+struct alignas(CACHE_LINE) TaStats {
+    std::atomic<int64_t> start_us;          // TA started
+    std::atomic<int64_t> end_us;            // TA exited
+    std::atomic<int64_t> busy_us;           // reviewing or marking, credited when done
+    std::atomic<int64_t> busy_since_us;     // now_us() the review or mark in hand
+                                            // began, 0 if none, -1 while it is
+                                            // being credited (real time only)
+    std::atomic<int64_t> idle_us;           // blocked on work_items
+    std::atomic<int64_t> lock_wait_us;      // blocked on a work deque lock / mutex_rubric
+    std::atomic<int64_t> lock_waits;        // lock acquisitions that had to block
+    std::atomic<int64_t> steals;            // work items taken from another TA's deque
+    std::atomic<int64_t> questions_marked;
+    std::atomic<int64_t> rubric_checks;     // rubric entries reviewed
+    std::atomic<int64_t> corrections;       // rubric entries changed
+    std::atomic<int32_t> state;             // TaState
+    std::atomic<int32_t> current_exam;      // student number in hand, -1 if none
+};
+
+static inline void metric_add(std::atomic<int64_t> &m, int64_t v) {
+    m.store(m.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+static inline void metric_set(std::atomic<int32_t> &m, int32_t v) {
+    m.store(v, std::memory_order_relaxed);
+}
+
+static inline int64_t metric(const std::atomic<int64_t> &m) {
+    return m.load(std::memory_order_relaxed);
+}
+
+// What a TA holds that must be handed back if it dies (TaSlot::phase)
+enum TaPhase {
+    PH_IDLE,    // nothing
+    PH_TOKEN,   // a work_items token, no item yet
+    PH_ITEM,    // the work item in item_seq / item_q
+    PH_COUNTED, // that item, done and counted off its exam
+};
+
+#define HELD_NONE   -1          // TaSlot::held_lock: no lock
+#define HELD_RUBRIC -2          // mutex_rubric; >= 0 is a work deque index
+
+// Supervision state of one TA slot. The TA publishes what it is holding and
+// when it will next check in; the parent reads that to spot a dead or hung
+// TA and to undo whatever it was in the middle of. active and retire are
+// the parent's side: whether new exams are dealt to this slot, and a
+// request to leave the pool at the next work item boundary.
+struct alignas(CACHE_LINE) TaSlot {
+    std::atomic<int64_t> deadline_us;   // TA checks in again by then
+                                        // (INT64_MAX while blocked on a lock)
+    std::atomic<int32_t> phase;         // TaPhase
+    std::atomic<int32_t> item_seq;      // work item held in PH_ITEM / PH_COUNTED
+    std::atomic<int32_t> item_q;
+    std::atomic<int32_t> item_kind;
+    std::atomic<int32_t> held_lock;     // HELD_NONE, HELD_RUBRIC or a deque index
+    std::atomic<int32_t> generation;    // TAs started in this slot so far
+    std::atomic<int32_t> active;        // parent: slot is in the pool
+    std::atomic<int32_t> retire;        // parent: leave the pool
+};
+
+// What a work item asks for
+enum WorkKind {
+    WORK_MARK,      // mark question q of the exam
+    WORK_REVIEW,    // --review=partitioned: check rubric entry q for the exam
+};
+
+// One (exam, question) unit of work
+struct WorkItem {
+    int seq;    // exam number, see exam_slot()
+    int q;      // question index
+    int kind;   // WorkKind
+};
+
+// Per-TA work deque: a circular buffer of ring_slots * num_questions
+// WorkItems that follows the header. The parent appends whole exams at the
+// tail, the owner pops from the head (oldest exam first) and idle TAs steal
+// from the tail. head/tail only change under lock; they are atomics so a
+// thief can skip an empty deque without taking its lock.
+struct alignas(CACHE_LINE) WorkDeque {
+    sem_t lock;
+    std::atomic<int> head;  // next item the owner pops
+    std::atomic<int> tail;  // one past the newest item
+};
+
+// Byte offsets of the runtime-sized arrays that follow SharedArea in the
+// segment. Computed once by the parent from the rubric and the command line.
+struct ShmLayout {
+    size_t rubric;      // std::atomic<char>[num_questions]
+    size_t rubric_stamps; // std::atomic<uint64_t>[num_questions]: rubric_version
+                          // of each entry's latest change (0 = never changed)
+    size_t slots;       // ExamSlot[ring_slots]
+    size_t states;      // ring_slots rows, state_stride bytes apart, of
+                        // int[num_questions] question states: 0 = not started,
+                        // 1 = marking, 2 = done; then int[num_questions] review
+                        // states (--review=partitioned): 0 = to check, 2 = checked
+    size_t state_stride;
+    size_t log_rings;   // LogRing[num_TAs + 1]
+    size_t results;     // ResultRing
+    size_t sim_actors;  // SimActor[num_TAs + 1], used with --simulate
+    size_t ta_stats;    // TaStats[num_TAs]
+    size_t ta_slots;    // TaSlot[num_TAs]
+    size_t deques;      // num_TAs work deques, deque_stride bytes apart
+    size_t deque_stride;
+    size_t total;
+};
+
+// Shared memory structure (header; arrays follow at layout offsets).
+// Fields are grouped by who writes them and how often, one group per
+// cache line, so a hot counter never shares a line with data other cores
+// only read. The static_asserts below keep it that way.
+struct SharedArea {
+    // Set up by the parent before any TA starts, read-only afterwards
+    uint32_t  magic;                    // SHARED_AREA_MAGIC
+    uint32_t  version;                  // SHARED_AREA_VERSION
+    pid_t     parent_pid;               // the marker parent
+    int64_t   started_us;               // now_us() at startup
+    int       num_questions;            // Rubric size, fixed at startup
+    int       ring_slots;               // Exams loaded ahead by the parent
+    int       num_TAs;                  // TA slots (--max-tas), for posting one stop
+                                        // token each
+    int       min_TAs;                  // pool bounds (--min-tas, --max-tas)
+    ShmLayout layout;
+
+    int       mode;                     // RunMode
+    int       simulate;                 // 1 = virtual clock, sleeps cost no real time
+    double    delay_scale;              // multiplier on review/marking delays
+    int       delay_dist;               // DelayDist
+    DelaySpec review_delay;             // per rubric entry check
+    DelaySpec mark_delay;               // per question marked
+    int       review_policy;            // ReviewPolicy
+    int       review_every;             // REVIEW_EVERY: full review every N exams
+    int       results;                  // 1 = TAs append to the results ring (--results)
+    uint64_t  seed;                     // base seed, each TA derives its own stream
+
+    // Written on every log line by every process
+    alignas(CACHE_LINE) std::atomic<uint64_t> log_counter; // Shared global action counter
+                                                           // (to observe interleaving)
+
+    // Written on every work item taken or queued
+    alignas(CACHE_LINE) std::atomic<int> queued; // work items sitting in the deques
+    std::atomic<int> reviews_open;      // --review=partitioned: exams whose questions
+                                        // are not queued yet (review still out)
+    std::atomic<int> stops_held;        // stop tokens taken while a review was out,
+                                        // posted again once one is released
+    alignas(CACHE_LINE) sem_t work_items; // one token per queued work item, plus one
+                                          // stop token per TA once input_closed is set
+
+    // Rubric writers. Rubric letters live in the rubric array. Readers load
+    // entries without any lock; writers serialize on mutex_rubric and bump
+    // rubric_seq around each change (seqlock) so a whole-rubric snapshot can
+    // be read consistently.
+    alignas(CACHE_LINE) sem_t mutex_rubric;
+    std::atomic<uint32_t> rubric_seq;   // odd while a writer is mid-update
+    std::atomic<uint64_t> rubric_version; // bumped once per rubric change, and
+                                          // stamped on the entry that changed
+    std::atomic<int> rubric_dirty;      // 1 = rubric changed in SHM, parent must write to file
+
+    // Posted by TAs when an exam finishes or the rubric becomes dirty; the
+    // parent sleeps on it
+    alignas(CACHE_LINE) sem_t parent_wake;
+
+    // Written by the parent, rarely read by anyone else
+    alignas(CACHE_LINE) int load_seq;   // Exams loaded into the ring so far (parent only)
+    int  retire_seq;                    // Oldest exam the parent has not retired yet (parent only)
+    std::atomic<int> input_closed;      // 1 = sentinel or missing exam reached, no more loads
+    std::atomic<int> log_closed;        // 1 = no more log or result records, drainer and
+                                        // results writer may exit when empty
+    std::atomic<int> helper_lost;       // HelperBit of each helper that died: its
+                                        // records are dropped instead of waited on
+    std::atomic<int> running_TAs;       // TAs in the pool right now
+    std::atomic<int> ta_spawns;         // TAs started, the initial pool included
+    std::atomic<int> ta_deaths;         // TAs that died or hung and were reclaimed
+
+    // --simulate only: moved by whichever actor is running
+    alignas(CACHE_LINE) int64_t sim_now_us; // virtual clock
+};
+
+// Hot fields each start their own cache line and the read-only header does
+// not reach into the first of them
+#define SH_LINE(field) (offsetof(SharedArea, field) / CACHE_LINE)
+static_assert(alignof(SharedArea) == CACHE_LINE &&
+              sizeof(SharedArea) % CACHE_LINE == 0,
+              "SharedArea must be whole cache lines");
+static_assert(SH_LINE(log_counter) != SH_LINE(seed) &&
+              SH_LINE(queued) != SH_LINE(log_counter) &&
+              SH_LINE(work_items) != SH_LINE(queued) &&
+              SH_LINE(mutex_rubric) != SH_LINE(work_items) &&
+              SH_LINE(parent_wake) != SH_LINE(rubric_dirty) &&
+              SH_LINE(load_seq) != SH_LINE(parent_wake) &&
+              SH_LINE(sim_now_us) != SH_LINE(log_closed),
+              "hot SharedArea fields must not share a cache line");
+static_assert(SH_LINE(rubric_dirty) == SH_LINE(mutex_rubric),
+              "rubric writer state should stay on one line");
+
+// The helpers consuming the rings, for SharedArea::helper_lost
+enum HelperBit { HELPER_LOG = 1, HELPER_RESULTS = 2 };
+
+// --simulate: every TA and the parent is an actor of a discrete-event
+// scheduler. Exactly one actor runs at a time; when it sleeps or blocks it
+// hands the CPU to the actor with the earliest wake time, and the virtual
+// clock jumps to that time. The code paths stay the same as a real run, only
+// the waits are replaced.
+enum SimState { SIM_RUNNABLE, SIM_BLOCKED, SIM_DONE };
+enum WaitOn   { WAIT_WORK, WAIT_PARENT };   // work_items / parent_wake
+
+struct alignas(CACHE_LINE) SimActor {
+    sem_t   turn;       // posted when the scheduler picks this actor
+    int64_t wake_at;    // virtual us it runs at next (INT64_MAX = no timeout)
+    int     state;      // SimState
+    int     wait_on;    // WaitOn, while SIM_BLOCKED
+    int     timed_out;  // 1 = the last blocking wait ended by its timeout
+};
+
+// Log event codes; the drainer turns each into the matching text line
+enum LogEvent : uint16_t {
+    EV_EXAM_LOADED,     // parent: idx, text = file name, sid
+    EV_SENTINEL,        // parent
+    EV_RUBRIC_SAVING,   // parent
+    EV_RUBRIC_SAVE_FAILED,
+    EV_TERMINATING,     // parent
+    EV_ALL_DONE,        // parent
+    EV_START_STUDENT,   // TA: sid
+    EV_RUBRIC_CHECK,    // TA: q, letter
+    EV_RUBRIC_CORRECT,  // TA: q, old, new
+    EV_RUBRIC_SAME,     // TA: q, letter
+    EV_MARKING,         // TA: q, sid, letter
+    EV_FINISHED,        // TA: q, sid
+    EV_EXAM_DONE,       // TA: sid
+    EV_WAITING,         // TA
+    EV_TA_EXIT,         // TA
+    EV_TA_STARTED,      // parent: ta, queued, running
+    EV_TA_DIED,         // parent: ta, text = how
+    EV_TA_HUNG,         // parent: ta, ms overdue, killed
+    EV_REQUEUED,        // parent: q, sid, ta, WorkKind
+    EV_TA_RETIRED,      // TA
+    EV_RESUMED,         // parent: exams retired before, rubric version
+    EV_ALREADY_MARKED,  // parent: q, sid
+    EV_REVIEW_SKIPPED,  // TA: rubric version
+    EV_REVIEW_DONE,     // TA: sid
+    EV_COUNTED_FOR,     // parent: q, sid, ta
+};
+
+// One binary log record (exactly one cache line). A string argument longer
+// than text[] goes on in the next `more` slots of the ring, as raw bytes; they
+// are published with the record and have no G-number of their own.
+struct LogRecord {
+    uint64_t g;         // G-sequence from log_counter
+    int32_t  source;    // TA id, or -1 for the parent
+    uint16_t event;     // LogEvent
+    uint16_t more;      // ring slots the string continues into
+    int32_t  arg[3];
+    char     sid[8];    // student id, if any
+    char     text[28];  // string argument, if any (its start, if more > 0)
+};
+static_assert(sizeof(LogRecord) == 64, "LogRecord should fill one cache line");
+
+#define LOG_TEXT_MAX 512        // longest string argument with its '\0', cut beyond
+
+// Single-producer / single-consumer ring, one per TA plus one for the parent.
+// The producer only writes head, the drainer only writes tail.
+struct alignas(CACHE_LINE) LogRing {
+    std::atomic<uint64_t> head;         // next record the producer will write
+    char pad0[CACHE_LINE - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> tail;         // next record the drainer will read
+    char pad1[CACHE_LINE - sizeof(std::atomic<uint64_t>)];
+    LogRecord rec[LOG_RING_SIZE];
+};
+// One marked question for the results file (--results)
+struct ResultRecord {
+    std::atomic<uint64_t> seq;  // position + 1 once published, for the writer
+    int64_t  t_us;              // clock_us() when it was marked
+    int32_t  ta;
+    uint32_t slot;              // exam slot, whose checkpoint done flag the
+                                // writer sets once the row is on disk
+    uint16_t q;                 // question, from 1
+    char     letter;            // rubric letter it was marked with
+    char     sid[5];            // student id
+};
+static_assert(sizeof(ResultRecord) == 32, "two ResultRecords per cache line");
+
+// Multi-producer / single-consumer ring: a TA reserves a position with a
+// fetch-add of head, fills the record and publishes it by storing seq; the
+// results writer consumes in position order and only writes tail, and
+// committed once a group commit is on disk.
+struct alignas(CACHE_LINE) ResultRing {
+    std::atomic<uint64_t> head;         // next position a TA will reserve
+    char pad0[CACHE_LINE - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> tail;         // next position the writer will read
+    char pad1[CACHE_LINE - sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t> committed;    // every position below it is on disk
+    std::atomic<uint64_t> commit_want;  // --simulate: commit up to here at once
+    char pad2[CACHE_LINE - 2 * sizeof(std::atomic<uint64_t>)];
+    ResultRecord rec[RESULT_RING_SIZE];
+};
+
+static_assert(sizeof(ExamSlot) == CACHE_LINE && sizeof(TaStats) % CACHE_LINE == 0 &&
+              sizeof(TaSlot) == CACHE_LINE &&
+              sizeof(SimActor) % CACHE_LINE == 0 && sizeof(LogRing) % CACHE_LINE == 0 &&
+              sizeof(ResultRing) % CACHE_LINE == 0,
+              "per-slot and per-TA entries must not share cache lines");
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+              std::atomic<char>::is_always_lock_free,
+              "shared atomics must be lock-free to work across processes");
+
+/**
+ * Current CLOCK_MONOTONIC time in microseconds, the time base of every
+ * real-time timestamp in the segment.
+ */
+static inline int64_t now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline size_t align_up(size_t off, size_t align) {
+    return (off + align - 1) & ~(align - 1);
+}
+
+/**
+ * Lay the segment out, every region starting on a cache line, as: header,
+ * rubric and its version stamps (read by every TA, so kept off lines
+ * anyone writes often), exam
+ * slots, question states (one row per slot, each on its own lines),
+ * then one log ring per TA plus one for the parent (ring num_TAs), the
+ * results ring, and one
+ * simulation actor per TA plus one for the parent (actor num_TAs), the
+ * per-TA statistics and supervision slots, and the per-TA work deques.
+ */
+static inline ShmLayout compute_layout(int num_questions, int ring_slots, int num_TAs) {
+    ShmLayout l;
+    size_t off = sizeof(SharedArea);
+    l.rubric = off;
+    off += num_questions * sizeof(std::atomic<char>);
+    l.rubric_stamps = off = align_up(off, alignof(std::atomic<uint64_t>));
+    off += num_questions * sizeof(std::atomic<uint64_t>);
+    l.slots = off = align_up(off, alignof(ExamSlot));
+    off += ring_slots * sizeof(ExamSlot);
+    l.states = off = align_up(off, CACHE_LINE);
+    l.state_stride = align_up(2 * num_questions * sizeof(int), CACHE_LINE);
+    off += ring_slots * l.state_stride;
+    l.log_rings = off = align_up(off, alignof(LogRing));
+    off += (num_TAs + 1) * sizeof(LogRing);
+    l.results = off = align_up(off, alignof(ResultRing));
+    off += sizeof(ResultRing);
+    l.sim_actors = off = align_up(off, alignof(SimActor));
+    off += (num_TAs + 1) * sizeof(SimActor);
+    l.ta_stats = off = align_up(off, alignof(TaStats));
+    off += num_TAs * sizeof(TaStats);
+    l.ta_slots = off = align_up(off, alignof(TaSlot));
+    off += num_TAs * sizeof(TaSlot);
+    l.deques = off = align_up(off, alignof(WorkDeque));
+    l.deque_stride = align_up(sizeof(WorkDeque) + static_cast<size_t>(ring_slots) *
+                              num_questions * sizeof(WorkItem), alignof(WorkDeque));
+    off += num_TAs * l.deque_stride;
+    l.total = off;
+    return l;
+}
+
+static inline std::atomic<char> &rubric_at(SharedArea *sh, int q) {
+    return reinterpret_cast<std::atomic<char> *>(
+        reinterpret_cast<char *>(sh) + sh->layout.rubric)[q];
+}
+
+static inline std::atomic<uint64_t> &rubric_stamp(SharedArea *sh, int q) {
+    return reinterpret_cast<std::atomic<uint64_t> *>(
+        reinterpret_cast<char *>(sh) + sh->layout.rubric_stamps)[q];
+}
+
+static inline ExamSlot *exam_slot(SharedArea *sh, int seq) {
+    return reinterpret_cast<ExamSlot *>(
+        reinterpret_cast<char *>(sh) + sh->layout.slots) + seq % sh->ring_slots;
+}
+
+static inline int *question_states(SharedArea *sh, int seq) {
+    return reinterpret_cast<int *>(
+        reinterpret_cast<char *>(sh) + sh->layout.states +
+        (seq % sh->ring_slots) * sh->layout.state_stride);
+}
+
+static inline int *review_states(SharedArea *sh, int seq) {
+    return question_states(sh, seq) + sh->num_questions;
+}
+
+static inline LogRing *log_ring(SharedArea *sh, int idx) {
+    return reinterpret_cast<LogRing *>(
+        reinterpret_cast<char *>(sh) + sh->layout.log_rings) + idx;
+}
+
+static inline ResultRing *result_ring(SharedArea *sh) {
+    return reinterpret_cast<ResultRing *>(
+        reinterpret_cast<char *>(sh) + sh->layout.results);
+}
+
+static inline SimActor *sim_actor(SharedArea *sh, int idx) {
+    return reinterpret_cast<SimActor *>(
+        reinterpret_cast<char *>(sh) + sh->layout.sim_actors) + idx;
+}
+
+static inline TaStats *ta_stats(SharedArea *sh, int ta_id) {
+    return reinterpret_cast<TaStats *>(
+        reinterpret_cast<char *>(sh) + sh->layout.ta_stats) + ta_id;
+}
+
+static inline TaSlot *ta_slot(SharedArea *sh, int ta_id) {
+    return reinterpret_cast<TaSlot *>(
+        reinterpret_cast<char *>(sh) + sh->layout.ta_slots) + ta_id;
+}
+
+static inline WorkDeque *work_deque(SharedArea *sh, int ta_id) {
+    return reinterpret_cast<WorkDeque *>(
+        reinterpret_cast<char *>(sh) + sh->layout.deques +
+        ta_id * sh->layout.deque_stride);
+}
+
+static inline WorkItem *deque_item(SharedArea *sh, WorkDeque *d, int pos) {
+    int cap = sh->ring_slots * sh->num_questions;
+    return reinterpret_cast<WorkItem *>(d + 1) + pos % cap;
+}
+
+#endif // SHARED_AREA_H
@@ -0,0 +1,130 @@
+#!/bin/bash
+#
+# Throughput / latency benchmark for the Part B marker
+# - Sweeps execution mode (processes / threads), TA count, exam count and
+#   question count
+# - Generates a throw-away rubric and exam set for each point
+# - Runs ./marker with --stats and collects one row per run into
+#   tests/bench_results.csv and tests/bench_results.json
+# - With BASELINE=<old csv>, flags runs whose exams/sec dropped by more
+#   than TOLERANCE percent
+#
+# Sweep and options can be overridden from the environment, e.g.
+#   TAS="2 4 8" EXAMS="50" QUESTIONS="5 40" SCALE=0.001 ./tests/bench.sh
+#   SIMULATE=1 ./tests/bench.sh            # virtual clock instead of sleeps
+#   MODES=threads ./tests/bench.sh         # only the threaded backend
+#
+
+set -e  # exit on first error
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+PROJECT_DIR="$(dirname "$SCRIPT_DIR")"
+cd "$PROJECT_DIR"
+
+EXE="./marker"
+MODES="${MODES:-process threads}"
+TAS="${TAS:-2 4 8 16}"
+EXAMS="${EXAMS:-20 200}"
+QUESTIONS="${QUESTIONS:-5 40}"
+SCALE="${SCALE:-0.001}"         # 0.5-1 s review -> 0.5-1 ms
+SIMULATE="${SIMULATE:-0}"
+SEED="${SEED:-1}"               # same seed -> same workload between builds
+EXTRA_ARGS="${EXTRA_ARGS:-}"    # passed through to marker
+TOLERANCE="${TOLERANCE:-10}"
+CSV="${CSV:-tests/bench_results.csv}"
+JSON="${JSON:-tests/bench_results.json}"
+
+WORK="$(mktemp -d)"
+trap 'rm -rf "$WORK"' EXIT
+
+make -s
+
+# Build the exams for one <questions>q/<exams> point
+make_data() {
+    local nq="$1" ne="$2"
+    local dir="$WORK/${nq}q_${ne}e"
+    mkdir -p "$dir/exams"
+    for i in $(seq 1 "$ne"); do
+        printf "%04d\nbench exam\n" "$i" > "$dir/exams/exam$(printf "%02d" "$i").txt"
+    done
+    printf "9999\n" > "$dir/exams/exam$(printf "%02d" $((ne + 1))).txt"
+    echo "$dir"
+}
+
+# Fresh rubric before every run: the marker rewrites it
+make_rubric() {
+    local nq="$1" dir="$2"
+    for q in $(seq 1 "$nq"); do
+        echo "$q, A"
+    done > "$dir/rubric.txt"
+}
+
+# Pull a number out of the flat stats JSON
+field() {
+    sed -n "s/.*\"$1\": \([0-9.e+-]*\).*/\1/p" "$2"
+}
+
+SIM_ARG=""
+if [ "$SIMULATE" = "1" ]; then
+    SIM_ARG="--simulate"
+fi
+
+echo "mode,tas,questions,exams,elapsed_s,exams_per_sec,lat_p50_ms,lat_p90_ms,lat_p99_ms,lat_max_ms,ta_busy_fraction,ta_idle_fraction,lock_wait_ms,lock_waits,steals" > "$CSV"
+echo "[" > "$JSON"
+first=1
+
+for nq in $QUESTIONS; do
+    for ne in $EXAMS; do
+        dir="$(make_data "$nq" "$ne")"
+        for nt in $TAS; do
+            for mode in $MODES; do
+                make_rubric "$nq" "$dir"
+                stats="$WORK/stats.json"
+                echo " Running: $mode, $nt TAs, $ne exams, $nq questions"
+                # shellcheck disable=SC2086
+                "$EXE" --mode="$mode" $SIM_ARG --seed="$SEED" --delay-scale="$SCALE" \
+                    --stats="$stats" $EXTRA_ARGS \
+                    "$nt" "$dir/rubric.txt" "$dir/exams" > /dev/null
+
+                row="$mode,$nt,$nq,$ne"
+                for key in elapsed_s exams_per_sec p50 p90 p99 max \
+                           ta_busy_fraction ta_idle_fraction lock_wait_ms lock_waits steals; do
+                    row="$row,$(field "$key" "$stats")"
+                done
+                echo "$row" >> "$CSV"
+
+                if [ $first -eq 0 ]; then
+                    echo "," >> "$JSON"
+                fi
+                first=0
+                tr -d '\n' < "$stats" >> "$JSON"
+            done
+        done
+    done
+done
+
+echo "" >> "$JSON"
+echo "]" >> "$JSON"
+
+echo
+column -s, -t < "$CSV" 2>/dev/null || cat "$CSV"
+echo
+echo "Results: $CSV, $JSON"
+
+# Optional regression check against an earlier CSV
+if [ -n "$BASELINE" ]; then
+    echo
+    echo "Comparing exams/sec against $BASELINE (tolerance ${TOLERANCE}%):"
+    awk -F, -v tol="$TOLERANCE" '
+        NR == FNR { if (FNR > 1) base[$1 "," $2 "," $3 "," $4] = $6; next }
+        FNR > 1 {
+            key = $1 "," $2 "," $3 "," $4
+            if (!(key in base) || base[key] <= 0) next
+            change = 100 * ($6 - base[key]) / base[key]
+            flag = (change < -tol) ? "  REGRESSION" : ""
+            if (flag != "") bad = 1
+            printf "  %s, %s TAs / %s q / %s exams: %.3f -> %.3f exams/s (%+.1f%%)%s\n",
+                   $1, $2, $3, $4, base[key], $6, change, flag
+        }
+        END { exit bad }' "$BASELINE" "$CSV"
+fi
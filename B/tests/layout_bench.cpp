@@ -0,0 +1,168 @@
+/**
+ * False-sharing microbenchmark for the shared segment layout.
+ *
+ * Replays the three hottest access patterns of marker with N threads
+ * (default: max(16, cores)), once on the old packed layout and once on
+ * the cache-line-aligned one, and prints the throughput of each:
+ *
+ *   stats   - every TA bumps its own TaStats counters
+ *             (56-byte entries vs one cache line per TA)
+ *   header  - every TA fetch_adds log_counter and reads the read-only
+ *             config (num_questions, ring_slots) as take_work() does
+ *             (same line vs separate lines)
+ *   slots   - TAs count down questions_left of different exam slots
+ *             (48-byte slots vs one cache line per slot)
+ *
+ * Cross-core traffic shows up as lost throughput in the packed runs; with
+ * a single core both layouts run at the same speed.
+ *
+ *   make microbench            # or: tests/layout_bench [threads] [iterations]
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#define CACHE_LINE 64
+
+// --- stats: per-TA counters -------------------------------------------------
+
+struct PackedStats {
+    int64_t start_us, end_us, busy_us, idle_us, lock_wait_us, lock_waits, steals;
+};
+
+struct alignas(CACHE_LINE) PaddedStats {
+    int64_t start_us, end_us, busy_us, idle_us, lock_wait_us, lock_waits, steals;
+};
+
+static_assert(sizeof(PackedStats) == 56 && sizeof(PaddedStats) == CACHE_LINE,
+              "layouts under test");
+
+template <typename Stats>
+static void stats_worker(Stats *all, int id, long iters) {
+    // volatile: every update must reach the cache line, as in marker
+    volatile Stats *mine = &all[id];
+    for (long i = 0; i < iters; i++) {
+        mine->busy_us = mine->busy_us + 1;
+        mine->lock_waits = mine->lock_waits + 1;
+    }
+}
+
+// --- header: log_counter next to the read-only config -----------------------
+
+struct PackedHeader {
+    int num_questions;
+    int ring_slots;
+    int num_TAs;
+    std::atomic<uint64_t> log_counter;
+};
+
+struct PaddedHeader {
+    int num_questions;
+    int ring_slots;
+    int num_TAs;
+    alignas(CACHE_LINE) std::atomic<uint64_t> log_counter;
+    char pad[CACHE_LINE - sizeof(std::atomic<uint64_t>)];
+};
+
+template <typename Header>
+static void header_worker(Header *h, int, long iters) {
+    volatile int *nq = &h->num_questions;
+    volatile int *rs = &h->ring_slots;
+    long sum = 0;
+    for (long i = 0; i < iters; i++) {
+        // one log line per few work items, each of which reads the config
+        if (i % 4 == 0) {
+            h->log_counter.fetch_add(1, std::memory_order_relaxed);
+        }
+        sum += *nq * *rs;
+    }
+    if (sum == 42) {
+        std::printf(" ");   // keep the reads
+    }
+}
+
+// --- slots: questions_left of neighbouring exam slots -----------------------
+
+struct PackedSlot {
+    char student_id[5];
+    const char *text;
+    uint32_t text_len;
+    std::atomic<int> questions_left;
+    std::atomic<int> exam_done;
+    int64_t loaded_us;
+    int64_t done_us;
+};
+
+struct alignas(CACHE_LINE) PaddedSlot {
+    char student_id[5];
+    const char *text;
+    uint32_t text_len;
+    std::atomic<int> questions_left;
+    std::atomic<int> exam_done;
+    int64_t loaded_us;
+    int64_t done_us;
+};
+
+template <typename Slot>
+static void slot_worker(Slot *all, int id, long iters) {
+    Slot *mine = &all[id];
+    for (long i = 0; i < iters; i++) {
+        mine->questions_left.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+/**
+ * Run fn(area, id, iters) on num_threads threads; returns million ops/s.
+ */
+template <typename T, typename Fn>
+static double run(Fn fn, T *area, int num_threads, long iters) {
+    std::vector<std::thread> threads;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back(fn, area, i, iters);
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    double secs = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - t0).count();
+    return num_threads * static_cast<double>(iters) / secs / 1e6;
+}
+
+static void report(const char *name, double packed, double padded) {
+    std::printf("%-8s %12.1f %12.1f %9.2fx\n", name, packed, padded, padded / packed);
+}
+
+int main(int argc, char *argv[]) {
+    int hw = static_cast<int>(std::thread::hardware_concurrency());
+    int num_threads = argc > 1 ? std::atoi(argv[1]) : (hw > 16 ? hw : 16);
+    long iters = argc > 2 ? std::atol(argv[2]) : 5000000L;
+    if (num_threads < 1 || iters < 1) {
+        std::fprintf(stderr, "Usage: %s [threads] [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::printf("%d threads, %ld iterations each, %d cores\n", num_threads, iters, hw);
+    std::printf("%-8s %12s %12s %10s\n", "pattern", "packed Mop/s", "padded Mop/s", "speedup");
+
+    std::vector<PackedStats> ps(num_threads);
+    std::vector<PaddedStats> pd(num_threads);
+    report("stats", run(stats_worker<PackedStats>, ps.data(), num_threads, iters),
+                    run(stats_worker<PaddedStats>, pd.data(), num_threads, iters));
+
+    PackedHeader hp = {5, 4, num_threads, {0}};
+    PaddedHeader hd = {5, 4, num_threads, {0}, {}};
+    report("header", run(header_worker<PackedHeader>, &hp, num_threads, iters),
+                     run(header_worker<PaddedHeader>, &hd, num_threads, iters));
+
+    std::vector<PackedSlot> sp(num_threads);
+    std::vector<PaddedSlot> sd(num_threads);
+    report("slots", run(slot_worker<PackedSlot>, sp.data(), num_threads, iters / 4),
+                    run(slot_worker<PaddedSlot>, sd.data(), num_threads, iters / 4));
+    return EXIT_SUCCESS;
+}
@@ -40,12 +40,40 @@ run_test() {
    # Run test with line-buffered stdout/stderr
     stdbuf -oL -eL "$EXE" "$NUM_TAS" "$RUBRIC" "$EXAMS" > "$LOGFILE" 2>&1
 
+    # No question marked twice, every exam completed, G strictly increasing...
+    ./marker-analyze "$LOGFILE" > /dev/null ||
+        { echo " $LOGFILE breaks an invariant, see ./marker-analyze $LOGFILE"; exit 1; }
 }
 
-# Run the three scenarios
+# The same student marked several times over (a regrade) is not a violation
+run_repeat_test() {
+    local LOGFILE="$TESTDIR/partB_repeat.log"
+    local DIR
+    DIR="$(mktemp -d)"
+
+    echo "-------------------------------------------------------"
+    echo " Running Part B test with student 0042 loaded 4 times..."
+    echo " Output → $LOGFILE"
+    echo "-------------------------------------------------------"
+
+    for i in 1 2 3 4; do
+        printf '0042\nExam 0042 contents placeholder.\n' > "$DIR/exam0$i.txt"
+    done
+    printf '9999\n' > "$DIR/exam05.txt"
+
+    make reset_rubric
+    "$EXE" --simulate 3 "$RUBRIC" "$DIR" > "$LOGFILE" 2>&1
+    rm -rf "$DIR"
+
+    ./marker-analyze "$LOGFILE" > /dev/null ||
+        { echo " $LOGFILE breaks an invariant, see ./marker-analyze $LOGFILE"; exit 1; }
+}
+
+# Run the three scenarios, then the repeated student
 run_test 2
 run_test 3
 run_test 5
+run_repeat_test
 
 echo
 echo "All tests completed successfully."